@@ -7,7 +7,10 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <iomanip>
 #include <cstdint>
+#include <chrono>
+#include <thread>
 
 using namespace std;
 using namespace boost::filesystem;
@@ -31,12 +34,50 @@ int main(int argc, const char** argv) {
                 "Path to game folder")
             ("mod-path",
                 po::value<path>(),
-                "Path to root folder of a mod")
+                "Path to root folder (or zip archive) of a mod")
             ("submod-path",
                 po::value<path>(),
-                "Path to root folder of a sub-mod")
+                "Path to root folder (or zip archive) of a sub-mod")
+            ("cache-path",
+                po::value<path>(),
+                "Path to folder in which to cache parsed game files (and directory listings, with --ignore-case) "
+                "between runs")
+            ("snapshot",
+                po::value<path>(),
+                "Path to a snapshot of the parsed base game (as made by the `snapshot build` command)")
+            ("daemon",
+                po::value<path>(),
+                "Stay resident, serving audit requests on the Unix domain socket at this path")
+            ("watch",
+                "Audit every script file, and then re-audit files as they change on disk (Linux only)")
+            ("state",
+                po::value<path>(),
+                "Path to a file in which --daemon & --watch keep each file's findings between runs, so that only files "
+                "which have changed since are reparsed")
+            ("jobs,j",
+                po::value<uint>()->default_value(0),
+                "Number of mods to audit at once with the `batch` command (0 for one per core)")
+            ("stage-jobs",
+                po::value<string>()->default_value("8,0,1"),
+                "Workers for the `scan` command's read, build, & audit stages, comma-separated (0 for one per core)")
+            ("ignore-case",
+                "Resolve game file paths in any casing, as on Windows, by way of an index built up front")
+            ("lsp",
+                "Run as a Language Server Protocol server over stdin & stdout")
             ;
 
+        /* commands are given as positional arguments, e.g. `audit snapshot build --game-path ... --snapshot ...`,
+           `audit batch MOD_A MOD_B,SUBMOD_B ...`, or `audit scan [FILE ...]` */
+        po::options_description opt_hidden;
+        opt_hidden.add_options()
+            ("command", po::value<vector<string>>());
+
+        po::options_description opt_cmdline;
+        opt_cmdline.add(opt_spec).add(opt_hidden);
+
+        po::positional_options_description opt_positional;
+        opt_positional.add("command", -1);
+
         /* parse command line & optional configuration file (command-line options override --config file options)
          *
          * example config file contents:
@@ -46,7 +87,7 @@ int main(int argc, const char** argv) {
          */
 
         po::variables_map opt;
-        po::store(po::parse_command_line(argc, argv, opt_spec), opt);
+        po::store(po::command_line_parser(argc, argv).options(opt_cmdline).positional(opt_positional).run(), opt);
 
         if (opt.count("cfg")) {
             const string cfg_path = opt["cfg"].as<path>().string();
@@ -65,6 +106,77 @@ int main(int argc, const char** argv) {
 
         po::notify(opt);
 
+        /* stdout belongs to the protocol, so this comes before anything else could write to it */
+        if (opt.count("lsp"))
+            return pdx::lsp_server().run();
+
+        const vector<string> cmd = (opt.count("command")) ? opt["command"].as<vector<string>>() : vector<string>();
+
+        if (!cmd.empty() && cmd.front() != "scan") { // (`scan` needs the vfs, so it's handled below)
+            if (cmd.front() == "batch") {
+                if (cmd.size() < 2)
+                    throw runtime_error("the `batch` command requires the paths of the mods to audit (each of which "
+                                        "may be followed by its submods, comma-separated)");
+
+                vector<vector<path>> mod_stacks;
+
+                for (auto it = cmd.cbegin() + 1; it != cmd.cend(); ++it) {
+                    vector<path> stack;
+
+                    for (size_t start = 0, end; start <= it->size(); start = end + 1) {
+                        end = min(it->find(',', start), it->size());
+                        stack.emplace_back(it->substr(start, end - start));
+                    }
+
+                    mod_stacks.push_back(move(stack));
+                }
+
+                const auto t0 = chrono::steady_clock::now();
+                pdx::mod_batch batch(opt_game_path);
+                const auto t1 = chrono::steady_clock::now();
+
+                const size_t n_base_files = batch.n_base_files();
+                const size_t n_base_duplicates = batch.n_base_duplicates();
+                const double duplicate_rate = (n_base_files) ? 100.0 * n_base_duplicates / n_base_files : 0;
+
+                cout << "base " << n_base_files << " files, " << batch.n_base_parsed() << " parsed, "
+                     << n_base_duplicates << " duplicates (" << fixed << setprecision(1) << duplicate_rate << "%), "
+                     << chrono::duration_cast<chrono::milliseconds>(t1 - t0).count() << " ms" << endl;
+
+                uint n_jobs = opt["jobs"].as<uint>();
+
+                if (n_jobs == 0)
+                    n_jobs = max(thread::hardware_concurrency(), 1u);
+
+                for (auto&& report : batch.audit(mod_stacks, n_jobs))
+                    cout << report;
+
+                const auto t2 = chrono::steady_clock::now();
+                cout << "total " << chrono::duration_cast<chrono::milliseconds>(t2 - t0).count() << " ms" << endl;
+
+                return 0;
+            }
+
+            if (cmd != vector<string>{ "snapshot", "build" }) {
+                string s;
+                for (auto&& w : cmd) s += (s.empty() ? "" : " ") + w;
+                throw runtime_error("unknown command: " + s);
+            }
+
+            if (!opt.count("snapshot"))
+                throw runtime_error("the `snapshot build` command requires a --snapshot path to which to write it");
+
+            uint n_left_out = 0;
+            const uint n_files = pdx::snapshot::build(opt_game_path, opt["snapshot"].as<path>(),
+                [&](const string& pathname, const char* msg) {
+                    cerr << "warning: left out of snapshot: " << pathname << ": " << msg << endl;
+                    ++n_left_out;
+                });
+
+            cout << "snapshot of " << n_files << " files written (" << n_left_out << " left out)" << endl;
+            return 0;
+        }
+
         pdx::vfs vfs{ opt_game_path };
 
         if (opt.count("mod-path")) {
@@ -76,8 +188,76 @@ int main(int argc, const char** argv) {
         else if (opt.count("submod-path"))
             throw runtime_error("cannot specify --submod-path without also providing a --mod-path");
 
+        if (opt.count("ignore-case")) {
+            /* with a cache path, the directory listings behind the index are kept there, so that next time only those
+               directories which have changed need be read */
+            pdx::dir_cache dirs;
+            path dirs_path;
+
+            if (opt.count("cache-path")) {
+                dirs_path = opt["cache-path"].as<path>() / "dirs";
+
+                if (exists(dirs_path))
+                    dirs.load(dirs_path);
+            }
+
+            for (auto&& w : vfs.index_paths(&dirs).warnings())
+                cerr << "warning: " << w << endl;
+
+            if (!dirs_path.empty()) {
+                create_directories(dirs_path.parent_path());
+                dirs.save(dirs_path);
+            }
+        }
+
         /* done with program option processing */
 
+        if (!cmd.empty() && cmd.front() == "scan") {
+            /* audit every script file in the game & mod layers (or just the files given) through the staged pipeline,
+               and then report how busy each stage was */
+            const string& jobs = opt["stage-jobs"].as<string>();
+            uint n[3] = { 0, 0, 0 };
+
+            if (sscanf(jobs.c_str(), "%u,%u,%u", &n[0], &n[1], &n[2]) != 3)
+                throw runtime_error("--stage-jobs must be 3 comma-separated numbers: " + jobs);
+
+            pdx::audit_pipeline::options pipeline_opts;
+            pipeline_opts.n_readers = (n[0]) ? n[0] : max(thread::hardware_concurrency(), 1u);
+            pipeline_opts.n_builders = n[1];
+            pipeline_opts.n_auditors = (n[2]) ? n[2] : max(thread::hardware_concurrency(), 1u);
+
+            vector<pdx::audit_pipeline::input> inputs;
+
+            if (cmd.size() > 1) {
+                for (auto it = cmd.cbegin() + 1; it != cmd.cend(); ++it)
+                    inputs.push_back({ *it, { 0, *it, nullptr, nullptr, false } });
+            }
+            else
+                inputs = pdx::audit_pipeline::script_files(vfs);
+
+            pdx::audit_pipeline pipeline(pipeline_opts);
+
+            for (auto&& findings : pipeline.run(inputs))
+                cout << findings;
+
+            cout << "done " << inputs.size() << " files, " << llround(pipeline.wall_ms()) << " ms" << endl
+                 << pipeline.report();
+
+            return 0;
+        }
+
+        const path state_path = (opt.count("state")) ? opt["state"].as<path>() : path();
+
+        if (opt.count("daemon")) {
+            pdx::daemon_server server(vfs, opt["daemon"].as<path>(), state_path);
+            cerr << "listening on " << opt["daemon"].as<path>().string() << endl;
+            server.run();
+            return 0;
+        }
+
+        if (opt.count("watch"))
+            pdx::watcher(vfs, state_path).run(cout);
+
         pdx::error_queue errors;
         pdx::file_location loc("<null>", 0);
         char buf[32];
@@ -91,8 +271,43 @@ int main(int argc, const char** argv) {
         cout << fpE << endl;
         for (auto&& e : errors) cout << "error: " << e._msg << endl;
 
-        pdx::parser parser(vfs["common/landed_titles/swmh_landed_titles.txt"]);
-        cout << *parser.root_block();
+        const path landed_titles_virtual_path = "common/landed_titles/swmh_landed_titles.txt";
+        const path landed_titles_path = vfs[landed_titles_virtual_path];
+        pdx::vfs::location landed_titles_loc;
+        vfs.locate(&landed_titles_loc, landed_titles_virtual_path);
+
+        if (landed_titles_loc.case_mismatch)
+            cerr << "warning: " << landed_titles_virtual_path.string() << " differs in case from "
+                 << landed_titles_path.string() << endl;
+
+        if (opt.count("snapshot")) {
+            pdx::snapshot snapshot(opt["snapshot"].as<path>());
+            pdx::parsed_file landed_titles = snapshot.get(vfs, landed_titles_virtual_path);
+            cout << *landed_titles.root_block();
+        }
+        else if (landed_titles_loc.p_member) {
+            /* from a zip archive mod, inflated straight into memory */
+            pdx::parsed_file landed_titles = pdx::parsed_file::parse(
+                pdx::batch_loader::read(*landed_titles_loc.p_archive, *landed_titles_loc.p_member));
+            cout << *landed_titles.root_block();
+        }
+        else if (opt.count("cache-path")) {
+            const path cache_path = opt["cache-path"].as<path>();
+            const path fingerprints_path = cache_path / "fingerprints";
+
+            if (exists(fingerprints_path))
+                vfs.fingerprints().load(fingerprints_path);
+
+            pdx::parse_cache cache(cache_path / "trees", vfs.fingerprints());
+            pdx::parsed_file landed_titles = cache.get(landed_titles_path);
+            cout << *landed_titles.root_block();
+
+            vfs.fingerprints().save(fingerprints_path);
+        }
+        else {
+            pdx::parser parser(landed_titles_path);
+            cout << *parser.root_block();
+        }
     }
     catch (const exception& e) {
         cerr << "fatal: " << e.what() << endl;
@@ -0,0 +1,136 @@
+
+#include "async_stream.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+async_stream::async_stream(size_t chunk_sz, uint n_chunks)
+    : _chunk_sz(chunk_sz),
+      _chunks(n_chunks),
+      _n_filled(0),
+      _n_drained(0),
+      _done(false),
+      _cancel(false),
+      _p(nullptr),
+      _avail(0),
+      _draining(false) {
+
+    for (auto&& c : _chunks) {
+        c.data = std::make_unique<char[]>(chunk_sz);
+        c.size = 0;
+    }
+}
+
+
+async_stream::~async_stream() {
+    assert( !_thread.joinable() && "async_stream's derived class did not stop() it" );
+}
+
+
+void async_stream::start() {
+    _thread = std::thread(&async_stream::run, this);
+}
+
+
+void async_stream::stop() {
+    if (!_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cancel = true;
+    }
+
+    _cv_drained.notify_one();
+    _thread.join();
+}
+
+
+/* READER SIDE */
+
+size_t async_stream::read(char* buf, size_t max_size) {
+    while (_avail == 0) {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        if (_draining) {
+            /* hand the chunk we just finished back to the producer */
+            ++_n_drained;
+            _draining = false;
+            _cv_drained.notify_one();
+        }
+
+        _cv_filled.wait(lock, [this] { return _n_filled > _n_drained || _done; });
+
+        if (_n_filled == _n_drained) {
+            /* producer is done & everything it produced has been read */
+            if (_error)
+                std::rethrow_exception(_error);
+
+            return 0;
+        }
+
+        const chunk& c = _chunks[_n_drained % _chunks.size()];
+        _p = c.data.get();
+        _avail = c.size;
+        _draining = true;
+    }
+
+    size_t n = std::min(max_size, _avail);
+    memcpy(buf, _p, n);
+    _p += n;
+    _avail -= n;
+    return n;
+}
+
+
+void async_stream::finish() {
+    char buf[4096];
+    _avail = 0;
+    while (read(buf, sizeof(buf)) > 0);
+}
+
+
+/* PRODUCER SIDE */
+
+char* async_stream::acquire() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv_drained.wait(lock, [this] { return _n_filled - _n_drained < _chunks.size() || _cancel; });
+    return (_cancel) ? nullptr : _chunks[_n_filled % _chunks.size()].data.get();
+}
+
+
+void async_stream::publish(size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _chunks[_n_filled % _chunks.size()].size = size;
+        ++_n_filled;
+    }
+
+    _cv_filled.notify_one();
+}
+
+
+void async_stream::run() {
+    try {
+        produce();
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _error = std::current_exception();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _done = true;
+    }
+
+    _cv_filled.notify_one();
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,90 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+
+#include "byte_stream.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* async_stream -- a byte_stream whose bytes are produced ahead of the reader, on a thread of its own, so that producing
+ * the next piece (reading a file, inflating a zip member, ...) overlaps with the reader consuming the last one. the
+ * bytes are handed over in a fixed ring of chunks which are recycled as the reader drains them, so memory use is
+ * bounded by n_chunks * chunk_sz however long the stream.
+ *
+ * derived classes implement produce(), which repeatedly acquire()s an empty chunk, fills it, and publish()es it. they
+ * must call start() once fully constructed and stop() first thing in their destructors, so that the producer never
+ * sees a partially constructed or destroyed object. an exception escaping produce() is rethrown to the reader once
+ * it has read everything published before it.
+ */
+class async_stream : public byte_stream {
+    struct chunk {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    const size_t _chunk_sz;
+
+    /* chunks are filled & drained strictly in order, so they're simply numbered: the producer fills chunk _n_filled
+       (mod n_chunks) when _n_filled - _n_drained < n_chunks, and the reader drains chunk _n_drained when _n_drained <
+       _n_filled. the chunk being drained counts as full until the reader is done with it. */
+    std::vector<chunk> _chunks;
+    uint64_t _n_filled;
+    uint64_t _n_drained;
+    bool _done;     // producer has published its last chunk (or failed)
+    bool _cancel;   // reader has gone away, so producer should stop early
+    std::exception_ptr _error;
+    std::mutex _mutex; // guards everything above except the chunks' contents
+    std::condition_variable _cv_filled;
+    std::condition_variable _cv_drained;
+
+    /* reader's position within the chunk it's draining (only touched by the reader) */
+    const char* _p;
+    size_t _avail;
+    bool _draining;
+
+    std::thread _thread;
+
+    void run();
+
+protected:
+    async_stream(size_t chunk_sz, uint n_chunks);
+
+    void start();
+    void stop();
+
+    /* PRODUCER SIDE */
+
+    virtual void produce() = 0;
+
+    /* wait for an empty chunk of chunk_sz() bytes to fill, or return null if the reader has gone away */
+    char* acquire();
+
+    /* hand the chunk last acquired over to the reader, of which the first size bytes were filled */
+    void publish(size_t size);
+
+public:
+    async_stream(const async_stream&) = delete;
+    ~async_stream();
+
+    size_t chunk_sz() const noexcept { return _chunk_sz; }
+
+    size_t read(char* buf, size_t max_size) override;
+
+    /* skip whatever the reader hasn't read, so that errors which only come to light at the end of the stream (e.g., a
+       checksum mismatch) are reported even when the reader stops short of it */
+    void finish();
+};
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,388 @@
+#include "audit_pipeline.h"
+#include "parse_cache.h"
+#include "token_list.h"
+#include "hash.h"
+#include "error.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <set>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+typedef std::chrono::steady_clock clock_type;
+
+
+static double ms_since(clock_type::time_point t0) {
+    return std::chrono::duration<double, std::milli>(clock_type::now() - t0).count();
+}
+
+
+/* a file on its way through the pipeline, gaining a loaded_file, then a lexed_text, then a tree, and finally its
+   findings. any stage which fails leaves a fatal message, and the stages after it only pass the file along, as they
+   do a file which was given a shared tree when it was read. */
+struct pipeline_file {
+    size_t i; // into the inputs
+    loaded_file loaded;
+    lexed_text text;
+    parsed_file tree;
+    bool is_save;
+    uint64_t hash; // of its content
+    bool shared;   // its tree is another file's
+    std::string fatal;
+    size_t n_bytes; // charged against max_bytes
+};
+
+typedef std::unique_ptr<pipeline_file> work_ptr;
+
+
+/* bounded_queue -- a FIFO between two stages which makes producers wait while it's full, and which is exhausted once
+   it's empty & every producer is done */
+class bounded_queue {
+    std::mutex _mutex;
+    std::condition_variable _cv_space;
+    std::condition_variable _cv_ready;
+    std::deque<work_ptr> _q;
+    size_t _capacity;
+    uint _n_producers;
+
+public:
+    bounded_queue(size_t capacity, uint n_producers) : _capacity(std::max<size_t>(capacity, 1)),
+                                                       _n_producers(n_producers) {}
+
+    void push(work_ptr f) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv_space.wait(lock, [&] { return _q.size() < _capacity; });
+        _q.push_back(std::move(f));
+        _cv_ready.notify_one();
+    }
+
+    /* null once exhausted */
+    work_ptr pop() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv_ready.wait(lock, [&] { return !_q.empty() || _n_producers == 0; });
+
+        if (_q.empty())
+            return nullptr;
+
+        work_ptr f = std::move(_q.front());
+        _q.pop_front();
+        _cv_space.notify_one();
+        return f;
+    }
+
+    void producer_done() {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        if (--_n_producers == 0)
+            _cv_ready.notify_all();
+    }
+};
+
+
+/* byte_budget -- the memory taken by files in flight, which reading must wait on */
+class byte_budget {
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    size_t _max;
+    size_t _used;
+    size_t _peak;
+
+public:
+    byte_budget(size_t max) : _max(max), _used(0), _peak(0) {}
+
+    /* wait until n bytes fit (or nothing else is in flight), and then take them */
+    void acquire(size_t n) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [&] { return _used == 0 || _used + n <= _max; });
+        add_locked(n);
+    }
+
+    /* take n bytes regardless (for what a file grows into once it's past reading) */
+    void add(size_t n) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        add_locked(n);
+    }
+
+    void release(size_t n) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _used -= n;
+        _cv.notify_all();
+    }
+
+    size_t peak() const noexcept { return _peak; }
+
+private:
+    void add_locked(size_t n) { _used += n; _peak = std::max(_peak, _used); }
+};
+
+
+audit_pipeline::audit_pipeline(const options& opts) : _opts(opts), _wall_ms(0), _peak_bytes(0), _n_shared(0) {
+    if (_opts.n_builders == 0)
+        _opts.n_builders = std::max(std::thread::hardware_concurrency(), 1u);
+
+    _opts.n_readers = std::max(_opts.n_readers, 1u);
+    _opts.n_auditors = std::max(_opts.n_auditors, 1u);
+}
+
+
+/* the findings for a file which made it through (see file_auditor) */
+static std::string audit_file(const std::string& virtual_path, const pipeline_file& f) {
+    if (!f.fatal.empty())
+        return "fatal " + virtual_path + ": " + f.fatal + "\n";
+
+    const error_queue& errors = f.tree.errors();
+
+    if (errors.empty())
+        return "ok " + virtual_path + "\n";
+
+    std::string out;
+
+    for (auto&& e : errors)
+        out += "error " + virtual_path + ":L" + std::to_string(e._location.line()) + ": " + e.what() + "\n";
+
+    return out;
+}
+
+
+std::vector<std::string> audit_pipeline::run(const std::vector<input>& inputs) {
+    enum { READ, LEX, BUILD, AUDIT, N_STAGES };
+
+    const uint n_workers[N_STAGES] = { _opts.n_readers, 1, _opts.n_builders, _opts.n_auditors };
+    const char* const names[N_STAGES] = { "read", "lex", "build", "audit" };
+
+    std::atomic<uint64_t> busy_ns[N_STAGES];
+    std::atomic<size_t> n_files[N_STAGES];
+
+    for (uint s = 0; s < N_STAGES; ++s) {
+        busy_ns[s] = 0;
+        n_files[s] = 0;
+    }
+
+    /* queue k feeds stage k+1 */
+    bounded_queue to_lex(_opts.queue_depth, n_workers[READ]);
+    bounded_queue to_build(_opts.queue_depth, n_workers[LEX]);
+    bounded_queue to_audit(_opts.queue_depth, n_workers[BUILD]);
+
+    byte_budget budget(_opts.max_bytes);
+    tree_share trees;
+    std::atomic<size_t> next_input(0);
+    std::vector<std::string> findings(inputs.size());
+
+    const auto t0 = clock_type::now();
+
+    /* time a worker's handling of one file (not its waiting on the queues) against its stage */
+    auto timed = [&](uint stage, auto&& f) {
+        const auto t = clock_type::now();
+        f();
+        busy_ns[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - t).count();
+        ++n_files[stage];
+    };
+
+    /* give a file the tree of a duplicate which has been built since it was read, if any, dropping its text & tokens.
+       (looked for again at each stage, as the first copy is often just ahead of it in the pipeline.) */
+    auto take_shared = [&](pipeline_file* f) {
+        if (!trees.find(&f->tree, f->hash))
+            return false;
+
+        f->shared = true;
+        f->loaded = loaded_file();
+        f->text = lexed_text();
+        budget.release(f->n_bytes);
+        f->n_bytes = 0;
+        return true;
+    };
+
+    auto read = [&] {
+        size_t i;
+
+        while (( i = next_input++ ) < inputs.size()) {
+            const vfs::location& loc = inputs[i].loc;
+            boost::system::error_code ec;
+            const size_t size = (loc.p_member) ? loc.p_member->size : size_t(fs::file_size(loc.real_path, ec));
+
+            auto f = std::make_unique<pipeline_file>();
+            f->i = i;
+            f->is_save = false;
+            f->shared = false;
+            f->n_bytes = (ec) ? 0 : size + 2;
+            budget.acquire(f->n_bytes);
+
+            timed(READ, [&] {
+                try {
+                    f->loaded = (loc.p_member) ? batch_loader::read(*loc.p_archive, *loc.p_member)
+                                               : batch_loader::read(loc.real_path);
+                    f->hash = hash64(f->loaded.data.get(), f->loaded.size);
+                }
+                catch (const std::exception& e) {
+                    f->fatal = e.what();
+                }
+            });
+
+            if (f->fatal.empty())
+                take_shared(f.get());
+
+            to_lex.push(std::move(f));
+        }
+
+        to_lex.producer_done();
+    };
+
+    auto lex = [&] {
+        while (work_ptr f = to_lex.pop()) {
+            if (f->fatal.empty() && !f->shared && !take_shared(f.get())) {
+                timed(LEX, [&] {
+                    static const char SAVE_HEADER[] = "CK2txt";
+                    f->is_save = f->loaded.size >= sizeof(SAVE_HEADER) - 1
+                              && memcmp(f->loaded.data.get(), SAVE_HEADER, sizeof(SAVE_HEADER) - 1) == 0;
+
+                    try {
+                        f->text = lexed_text::lex(std::move(f->loaded));
+                        const size_t n = f->text.memory_size() - (f->text.size + 2); // (beyond its text)
+                        budget.add(n);
+                        f->n_bytes += n;
+                    }
+                    catch (const std::exception& e) {
+                        f->fatal = e.what();
+                    }
+                });
+            }
+
+            to_build.push(std::move(f));
+        }
+
+        to_build.producer_done();
+    };
+
+    auto build = [&] {
+        while (work_ptr f = to_build.pop()) {
+            if (f->fatal.empty() && !f->shared && !take_shared(f.get())) {
+                timed(BUILD, [&] {
+                    try {
+                        f->tree = (f->is_save) ? parsed_file::parse<savegame_policy>(std::move(f->text))
+                                               : parsed_file::parse<script_policy>(std::move(f->text));
+                        trees.add(f->hash, f->tree);
+                    }
+                    catch (const std::exception& e) {
+                        f->fatal = e.what();
+                    }
+                });
+            }
+
+            to_audit.push(std::move(f));
+        }
+
+        to_audit.producer_done();
+    };
+
+    auto audit = [&] {
+        while (work_ptr f = to_audit.pop()) {
+            timed(AUDIT, [&] {
+                findings[f->i] = audit_file(inputs[f->i].virtual_path, *f);
+                f->tree = parsed_file(); // (freeing it on this thread, too)
+            });
+
+            budget.release(f->n_bytes);
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (uint k = 0; k < n_workers[READ]; ++k)
+        threads.emplace_back(read);
+
+    threads.emplace_back(lex);
+
+    for (uint k = 0; k < n_workers[BUILD]; ++k)
+        threads.emplace_back(build);
+
+    for (uint k = 0; k < n_workers[AUDIT]; ++k)
+        threads.emplace_back(audit);
+
+    for (auto&& t : threads)
+        t.join();
+
+    _wall_ms = ms_since(t0);
+    _peak_bytes = budget.peak();
+    _n_shared = trees.n_hits();
+    _stats.clear();
+
+    for (uint s = 0; s < N_STAGES; ++s)
+        _stats.push_back({ names[s], n_workers[s], n_files[s], double(busy_ns[s]) / 1e6 });
+
+    return findings;
+}
+
+
+std::string audit_pipeline::report() const {
+    std::string out;
+
+    for (const auto& s : _stats) {
+        const double capacity = _wall_ms * s.n_workers;
+        const int pct = (capacity > 0) ? int(100 * s.busy_ms / capacity + 0.5) : 0;
+
+        out += "stage " + std::string(s.name) + ": " + std::to_string(s.n_workers) + " workers, "
+             + std::to_string(s.n_files) + " files, " + std::to_string(pct) + "% busy\n";
+    }
+
+    const size_t n_files = (_stats.empty()) ? 0 : _stats.front().n_files;
+    const int pct = (n_files) ? int(100.0 * _n_shared / n_files + 0.5) : 0;
+
+    out += "peak " + std::to_string((_peak_bytes + (1 << 20) - 1) >> 20) + " MB in flight\n";
+    out += "shared " + std::to_string(_n_shared) + " files (" + std::to_string(pct) + "%)\n";
+    return out;
+}
+
+
+static bool is_script(const std::string& path) {
+    std::string ext = fs::path(path).extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".txt";
+}
+
+
+std::vector<audit_pipeline::input> audit_pipeline::script_files(const vfs& v) {
+    std::set<std::string> virtual_paths;
+
+    for (size_t i = 0; i < v.n_layers(); ++i) {
+        if (const zip_archive* p_archive = v.layer_archive(i)) {
+            for (const auto& m : p_archive->members())
+                if (is_script(m.name))
+                    virtual_paths.insert(m.name);
+
+            continue;
+        }
+
+        const fs::path& root = v.layer_path(i);
+
+        if (!fs::is_directory(root))
+            continue;
+
+        for (fs::recursive_directory_iterator it(root), end; it != end; ++it)
+            if (fs::is_regular_file(it->status()) && is_script(it->path().string()))
+                virtual_paths.insert(it->path().lexically_relative(root).generic_string());
+    }
+
+    std::vector<input> inputs;
+
+    for (const auto& vp : virtual_paths) {
+        input in{ vp, {} };
+
+        if (v.locate(&in.loc, vp) && !in.loc.case_mismatch) // (else shadowed by the same path in another case)
+            inputs.push_back(std::move(in));
+    }
+
+    return inputs;
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,95 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "vfs.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* AUDIT_PIPELINE -- audits many files at once through four stages, each with a pool of workers of its own, connected
+ * by bounded queues:
+ *
+ *   read    files (or zip archive members) into memory                  (n_readers, I/O-bound)
+ *   lex     the text into a token list (see token_list)                 (always 1, the lexer being what it is)
+ *   build   a parse tree from the tokens                                (n_builders)
+ *   audit   the tree, i.e. evaluate rules over it, & release it         (n_auditors)
+ *
+ * so lexing, the one step which can't be spread across cores, overlaps with everything else, and a giant savegame
+ * being built into a tree doesn't hold up the lexing of the small history files behind it. a stage whose output
+ * queue is full waits (back-pressure), and reading also waits while the text & tokens of the files in flight (which
+ * a tree keeps until it's audited) exceed max_bytes, but never when nothing is in flight, so that a file bigger than
+ * that still gets through, alone. so memory use stays bounded however many files there are.
+ *
+ * a file whose content is the same as that of one still in flight (hashed as it's read) shares that one's tree rather
+ * than being lexed & built again (see tree_share). as trees are released once audited, only duplicates read while
+ * the first copy is still in the pipeline are caught, which keeps memory bounded as before.
+ *
+ * a text savegame (one starting with "CK2txt") is parsed as such; anything else is parsed as script. auditing
+ * currently amounts to reporting each file's parse errors, in file_auditor's format:
+ *
+ *   ok <path>
+ *   error <path>:L<line>: <message>
+ *   fatal <path>: <message>
+ */
+
+class audit_pipeline {
+public:
+    struct options {
+        uint n_readers;
+        uint n_builders;  // 0 for one per core
+        uint n_auditors;
+        uint queue_depth; // files waiting between any two stages
+        size_t max_bytes; // of files in flight, before reading waits
+
+        options() : n_readers(8), n_builders(0), n_auditors(1), queue_depth(16), max_bytes(size_t(256) << 20) {}
+    };
+
+    struct input {
+        std::string virtual_path;
+        vfs::location loc; // (any archive must outlive the run)
+    };
+
+    struct stage_stats {
+        const char* name;
+        uint n_workers;
+        size_t n_files;
+        double busy_ms; // summed over the stage's workers, not counting time spent waiting on the queues
+    };
+
+private:
+    options _opts;
+    std::vector<stage_stats> _stats;
+    double _wall_ms;
+    size_t _peak_bytes;
+    uint64_t _n_shared;
+
+public:
+    audit_pipeline(const options& = options());
+    audit_pipeline(const audit_pipeline&) = delete;
+
+    /* audit every file, returning each one's findings in the order given */
+    std::vector<std::string> run(const std::vector<input>&);
+
+    /* of the last run */
+    const std::vector<stage_stats>& stats() const noexcept { return _stats; }
+    double wall_ms() const noexcept { return _wall_ms; }
+    size_t peak_bytes() const noexcept { return _peak_bytes; } // in flight at once
+    uint64_t n_shared() const noexcept { return _n_shared; }    // files which shared another's tree
+
+    /* a line per stage, "stage <name>: <n> workers, <n> files, <n>% busy", plus "peak <n> MB in flight" and
+       "shared <n> files (<rate>%)" */
+    std::string report() const;
+
+    /* every script (.txt) file in any of the vfs's layers, by virtual path, with where each resolves to */
+    static std::vector<input> script_files(const vfs&);
+};
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,626 @@
+
+#include "batch_loader.h"
+#include "error.h"
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <exception>
+#include <new>
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PDX_HAVE_FSTAT 1
+#include <sys/stat.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define PDX_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* allocate room for a file of the given size, plus the 2 NUL bytes after it */
+static void make_room(loaded_file& f, size_t size) {
+    f.data = std::make_unique<char[]>(size + 2);
+    f.data[size] = f.data[size + 1] = '\0';
+    f.size = size;
+}
+
+
+/* a file which shrank between being sized & read is taken as it was read, with its 2 NUL bytes moved up to suit */
+static void truncate_to(loaded_file& f, size_t size) {
+    f.data[size] = f.data[size + 1] = '\0';
+    f.size = size;
+}
+
+
+#ifdef PDX_HAVE_IO_URING
+
+/* URING -- just enough of an io_uring, by way of the raw system calls (no liburing), for our purposes: a submission
+ * queue we fill & flush, and a completion queue we drain. no SQ polling, so the kernel only looks at what we've queued
+ * when we call enter(). */
+
+struct batch_loader::uring {
+    static const unsigned ENTRIES = 4 * MAX_IN_FLIGHT;
+
+    int fd;
+    io_uring_params params;
+
+    void* sq_ring;
+    size_t sq_ring_sz;
+    void* cq_ring;
+    size_t cq_ring_sz;
+    io_uring_sqe* sqes;
+    size_t sqes_sz;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned  sq_local_tail; // SQEs up to here have been filled but not necessarily published to the kernel
+
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+
+    uring();
+    ~uring() { release(); }
+
+    void release();
+
+    io_uring_sqe* next_sqe();
+    void enter(unsigned min_complete);
+    bool next_cqe(io_uring_cqe* p_cqe);
+};
+
+
+batch_loader::uring::uring()
+    : fd(-1), sq_ring(MAP_FAILED), sq_ring_sz(0), cq_ring(MAP_FAILED), cq_ring_sz(0), sqes(nullptr), sqes_sz(0) {
+
+    memset(&params, 0, sizeof(params));
+
+    if (( fd = syscall(__NR_io_uring_setup, ENTRIES, &params) ) < 0)
+        throw va_error("io_uring_setup failed: %s", strerror(errno));
+
+    /* make sure the kernel knows all the operations we need (and knows how to tell us so) */
+    const size_t probe_sz = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::unique_ptr<io_uring_probe, void (*)(void*)> probe( static_cast<io_uring_probe*>(calloc(1, probe_sz)), free );
+
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe.get(), 256) < 0) {
+        int e = errno;
+        release();
+        throw va_error("io_uring probe failed: %s", strerror(e));
+    }
+
+    for (uint8_t op : { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE }) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            release();
+            throw va_error("io_uring does not support operation %u", op);
+        }
+    }
+
+    sq_ring_sz = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_sz = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        sq_ring_sz = cq_ring_sz = std::max(sq_ring_sz, cq_ring_sz);
+
+    sq_ring = mmap(nullptr, sq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+
+    if (sq_ring != MAP_FAILED) {
+        cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP)
+            ? sq_ring
+            : mmap(nullptr, cq_ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    }
+
+    sqes_sz = params.sq_entries * sizeof(io_uring_sqe);
+    void* p_sqes = (cq_ring != MAP_FAILED)
+        ? mmap(nullptr, sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES)
+        : MAP_FAILED;
+
+    if (p_sqes == MAP_FAILED) {
+        int e = errno;
+        release();
+        throw va_error("io_uring mmap failed: %s", strerror(e));
+    }
+
+    sqes = static_cast<io_uring_sqe*>(p_sqes);
+
+    char* sq = static_cast<char*>(sq_ring);
+    sq_head  = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_local_tail = *sq_tail;
+
+    char* cq = static_cast<char*>(cq_ring);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+
+void batch_loader::uring::release() {
+    if (sqes)
+        munmap(sqes, sqes_sz);
+
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+        munmap(cq_ring, cq_ring_sz);
+
+    if (sq_ring != MAP_FAILED)
+        munmap(sq_ring, sq_ring_sz);
+
+    if (fd >= 0)
+        close(fd);
+
+    sqes = nullptr;
+    sq_ring = cq_ring = MAP_FAILED;
+    fd = -1;
+}
+
+
+/* a zeroed SQE to fill in, which will be submitted by the next enter() */
+io_uring_sqe* batch_loader::uring::next_sqe() {
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+
+    if (sq_local_tail - head >= params.sq_entries)
+        return nullptr;
+
+    unsigned i = sq_local_tail++ & *sq_mask;
+    sq_array[i] = i;
+    memset(&sqes[i], 0, sizeof(io_uring_sqe));
+    return &sqes[i];
+}
+
+
+/* submit everything queued, and wait for at least min_complete completions. the kernel may consume only some of the
+   queue (or refuse it for now, with EAGAIN or EBUSY), so what it hasn't consumed is counted afresh from its head each
+   time & resubmitted. if it's refusing while there are completions to reap (which is what frees it up), we return
+   early, and the rest goes with the next enter(). */
+void batch_loader::uring::enter(unsigned min_complete) {
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+    while (1) {
+        const unsigned n_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        const long n = syscall(__NR_io_uring_enter, fd, n_submit, min_complete, IORING_ENTER_GETEVENTS, nullptr, 0);
+
+        if (n >= 0) {
+            if (unsigned(n) >= n_submit)
+                return;
+
+            continue; // (partly consumed: submit the rest)
+        }
+
+        if (errno == EINTR)
+            continue;
+
+        if (errno != EAGAIN && errno != EBUSY)
+            throw va_error("io_uring_enter failed: %s", strerror(errno));
+
+        if (*cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+            return;
+
+        std::this_thread::yield();
+    }
+}
+
+
+bool batch_loader::uring::next_cqe(io_uring_cqe* p_cqe) {
+    unsigned head = *cq_head;
+
+    if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+        return false;
+
+    *p_cqe = cqes[head & *cq_mask];
+    __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+
+/* each file goes through: open & statx (concurrently, both by path), then as many reads as it takes, then close (which
+   we don't wait on). completions identify their file's slot & the operation in their user_data. */
+void batch_loader::load_uring(const std::vector<fs::path>& paths, const callback& on_load) {
+    enum : uint64_t { OP_OPEN, OP_STATX, OP_READ, OP_CLOSE, OP_BITS = 2 };
+
+    static const size_t MAX_READ = 1 << 30; // a READ's length is only 32 bits
+
+    struct slot {
+        loaded_file file;
+        struct statx stx;
+        int fd;
+        uint pending;  // operations outstanding, not counting close
+        bool reading;
+        size_t n_read;
+    };
+
+    uring& ring = *_up_ring;
+    std::vector<slot> slots(MAX_IN_FLIGHT);
+    std::vector<uint> free_slots;
+
+    for (uint i = MAX_IN_FLIGHT; i-- > 0; )
+        free_slots.push_back(i);
+
+    size_t next_path = 0;
+    uint outstanding = 0; // operations submitted (or queued) but not yet completed, including closes
+    std::exception_ptr error;
+
+    auto sqe_for = [&](uint s, uint64_t op) {
+        io_uring_sqe* sqe = ring.next_sqe();
+        assert( sqe && "io_uring submission queue overflow" );
+        sqe->user_data = (uint64_t(s) << OP_BITS) | op;
+        ++outstanding;
+        return sqe;
+    };
+
+    auto start = [&](uint s) {
+        slot& sl = slots[s];
+        sl.file = loaded_file{ paths[next_path++].string(), nullptr, 0, 0 };
+        sl.fd = -1;
+        sl.pending = 2;
+        sl.reading = false;
+        sl.n_read = 0;
+
+        io_uring_sqe* sqe = sqe_for(s, OP_OPEN);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(sl.file.pathname.c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+
+        sqe = sqe_for(s, OP_STATX);
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(sl.file.pathname.c_str());
+        sqe->len = STATX_SIZE | STATX_TYPE;
+        sqe->off = reinterpret_cast<uint64_t>(&sl.stx);
+    };
+
+    auto read_more = [&](uint s) {
+        slot& sl = slots[s];
+        io_uring_sqe* sqe = sqe_for(s, OP_READ);
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = sl.fd;
+        sqe->addr = reinterpret_cast<uint64_t>(sl.file.data.get() + sl.n_read);
+        sqe->len = std::min(MAX_READ, sl.file.size - sl.n_read);
+        sqe->off = sl.n_read;
+        ++sl.pending;
+    };
+
+    auto complete = [&](uint s) {
+        slot& sl = slots[s];
+
+        if (sl.fd >= 0) {
+            io_uring_sqe* sqe = sqe_for(s, OP_CLOSE);
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = sl.fd;
+        }
+
+        if (sl.file.error)
+            sl.file.data.reset();
+
+        if (!error) {
+            try {
+                on_load(sl.file);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+        }
+
+        sl.file = loaded_file{};
+        free_slots.push_back(s);
+    };
+
+    while (1) {
+        while (!error && next_path < paths.size() && !free_slots.empty()) {
+            start(free_slots.back());
+            free_slots.pop_back();
+        }
+
+        if (outstanding == 0)
+            break;
+
+        ring.enter(1);
+        io_uring_cqe cqe;
+
+        while (ring.next_cqe(&cqe)) {
+            --outstanding;
+
+            const uint s = cqe.user_data >> OP_BITS;
+            const uint64_t op = cqe.user_data & ((1 << OP_BITS) - 1);
+
+            if (op == OP_CLOSE)
+                continue;
+
+            slot& sl = slots[s];
+            --sl.pending;
+
+            if (cqe.res < 0)
+                sl.file.error = -cqe.res;
+            else if (op == OP_OPEN)
+                sl.fd = cqe.res;
+            else if (op == OP_READ) {
+                sl.n_read += cqe.res;
+
+                if (cqe.res == 0)
+                    truncate_to(sl.file, sl.n_read); // file shrank since statx
+                else if (sl.n_read < sl.file.size)
+                    read_more(s);
+            }
+
+            if (sl.pending > 0)
+                continue;
+
+            if (!sl.reading && !sl.file.error && !S_ISREG(sl.stx.stx_mode))
+                sl.file.error = (S_ISDIR(sl.stx.stx_mode)) ? EISDIR : EINVAL; // (no size to read up to)
+
+            if (!sl.reading && !sl.file.error) {
+                /* opened & sized, so on to reading */
+                sl.reading = true;
+
+                try {
+                    make_room(sl.file, sl.stx.stx_size);
+                }
+                catch (const std::bad_alloc&) {
+                    sl.file.error = ENOMEM; // (not thrown, as the ring still has other slots' operations in flight)
+                }
+
+                if (!sl.file.error && sl.file.size > 0) {
+                    read_more(s);
+                    continue;
+                }
+            }
+
+            complete(s);
+        }
+    }
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+#else
+
+struct batch_loader::uring {};
+
+void batch_loader::load_uring(const std::vector<fs::path>& paths, const callback& on_load) {
+    load_threads(paths, on_load);
+}
+
+#endif
+
+
+batch_loader::batch_loader(backend preferred) {
+#ifdef PDX_HAVE_IO_URING
+    if (preferred == backend::io_uring) {
+        try {
+            _up_ring = std::make_unique<uring>();
+        }
+        catch (const va_error&) {
+            /* fall back to the thread pool */
+        }
+    }
+#endif
+}
+
+
+batch_loader::~batch_loader() {}
+
+
+void batch_loader::load(const std::vector<fs::path>& paths, const callback& on_load) {
+    if (_up_ring)
+        load_uring(paths, on_load);
+    else
+        load_threads(paths, on_load);
+}
+
+
+/* THREAD POOL */
+
+/* read a whole regular file with plain blocking I/O, noting rather than throwing any I/O error */
+static void read_file(loaded_file& f) {
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> fp( std::fopen(f.pathname.c_str(), "rb"), std::fclose );
+    long size;
+
+    if (fp.get() == nullptr) {
+        f.error = (errno) ? errno : EIO;
+        return;
+    }
+
+    /* anything else has no size to read up to (ftell may give any old number for a directory, say) */
+#ifdef PDX_HAVE_FSTAT
+    struct stat st;
+
+    if (fstat(fileno(fp.get()), &st) != 0) {
+        f.error = (errno) ? errno : EIO;
+        return;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+        f.error = (S_ISDIR(st.st_mode)) ? EISDIR : EINVAL;
+        return;
+    }
+#else
+    boost::system::error_code ec;
+    const fs::file_status status = fs::status(f.pathname, ec);
+
+    if (!fs::is_regular_file(status)) {
+        f.error = (fs::is_directory(status)) ? EISDIR : EINVAL;
+        return;
+    }
+#endif
+
+    if (std::fseek(fp.get(), 0, SEEK_END) != 0 || ( size = std::ftell(fp.get()) ) < 0) {
+        f.error = (errno) ? errno : EIO;
+        return;
+    }
+
+    std::rewind(fp.get());
+    make_room(f, size);
+
+    const size_t n_read = std::fread(f.data.get(), 1, size, fp.get());
+
+    if (std::ferror(fp.get())) {
+        f.error = (errno) ? errno : EIO;
+        f.data.reset();
+    }
+    else if (n_read < size_t(size))
+        truncate_to(f, n_read); // (as with io_uring)
+}
+
+
+void batch_loader::load_threads(const std::vector<fs::path>& paths, const callback& on_load) {
+    run_pool(paths.size(), N_THREADS, [&](size_t i, loaded_file& f) {
+        f.pathname = paths[i].string();
+        errno = 0;
+        read_file(f);
+    }, on_load);
+}
+
+
+void batch_loader::load(const zip_archive& archive, const std::vector<const zip_archive::member*>& members,
+                        const callback& on_load) {
+    const uint n_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    run_pool(members.size(), n_threads, [&](size_t i, loaded_file& f) {
+        const zip_archive::member& m = *members[i];
+        f.pathname = archive.pathname() + ":" + m.name;
+
+        if ((m.flags & 0x1) || (m.method != zip_archive::STORED && m.method != zip_archive::DEFLATED)) {
+            f.error = ENOTSUP;
+            return;
+        }
+
+        try {
+            f = read(archive, m);
+        }
+        catch (const va_error&) {
+            f.error = EBADMSG;
+        }
+    }, on_load);
+}
+
+
+loaded_file batch_loader::read(const fs::path& path) {
+    loaded_file f{ path.string(), nullptr, 0, 0 };
+    errno = 0;
+    read_file(f);
+
+    if (f.error)
+        throw va_error("Could not read file: %s: %s", f.pathname.c_str(), strerror(f.error));
+
+    return f;
+}
+
+
+loaded_file batch_loader::read(const zip_archive& archive, const zip_archive::member& m) {
+    loaded_file f{ archive.pathname() + ":" + m.name, nullptr, 0, 0 };
+    make_room(f, m.size);
+    archive.read(m, f.data.get());
+    return f;
+}
+
+
+/* hand n_files to on_load (on the calling thread), as up to n_threads_max workers fill them in with read_one */
+void batch_loader::run_pool(size_t n_files, uint n_threads_max, const reader& read_one, const callback& on_load) {
+    std::atomic<size_t> next_path(0);
+    std::mutex mutex;
+    std::condition_variable cv_ready;
+    std::condition_variable cv_space;
+    std::deque<loaded_file> ready; // read, but not yet handed to on_load (at most MAX_IN_FLIGHT)
+    uint n_finished = 0;           // worker threads which have run out of work
+    bool cancel = false;
+
+    const uint n_threads = std::min<size_t>(n_threads_max, n_files);
+    std::vector<std::thread> threads;
+
+    auto work = [&] {
+        size_t i;
+
+        while (( i = next_path++ ) < n_files) {
+            loaded_file f{ std::string(), nullptr, 0, 0 };
+
+            /* nothing may escape a worker thread, so whatever read_one throws is noted as the file's error */
+            try {
+                read_one(i, f);
+            }
+            catch (const std::bad_alloc&) {
+                f.data.reset();
+                f.error = ENOMEM;
+            }
+            catch (...) {
+                f.data.reset();
+                f.error = EIO;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            cv_space.wait(lock, [&] { return ready.size() < MAX_IN_FLIGHT || cancel; });
+
+            if (cancel)
+                break;
+
+            ready.emplace_back( std::move(f) );
+            cv_ready.notify_one();
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ++n_finished;
+        cv_ready.notify_one();
+    };
+
+    for (uint i = 0; i < n_threads; ++i)
+        threads.emplace_back(work);
+
+    std::exception_ptr error;
+
+    while (1) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv_ready.wait(lock, [&] { return !ready.empty() || n_finished == n_threads; });
+
+        if (ready.empty())
+            break;
+
+        loaded_file f = std::move(ready.front());
+        ready.pop_front();
+        cv_space.notify_one();
+        lock.unlock();
+
+        try {
+            on_load(f);
+        }
+        catch (...) {
+            error = std::current_exception();
+            lock.lock();
+            cancel = true;
+            cv_space.notify_all();
+            break;
+        }
+    }
+
+    next_path = n_files; // in case of cancellation, so that no worker starts on another file
+
+    for (auto&& t : threads)
+        t.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+
+_PDX_NAMESPACE_END
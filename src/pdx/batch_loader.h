@@ -0,0 +1,85 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <boost/filesystem.hpp>
+
+#include "lexer.h"
+#include "zip_archive.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* loaded_file -- the whole of a file, read into memory & followed by the 2 NUL bytes which a memory_span needs */
+struct loaded_file {
+    std::string pathname;
+    std::unique_ptr<char[]> data;
+    size_t size;
+    int error; // errno if the file couldn't be read (in which case there's no data), else 0
+
+    memory_span span() noexcept { return memory_span{ data.get(), size, pathname.c_str() }; }
+};
+
+
+/* batch_loader -- reads many (typically small) files at once, e.g. everything under history/characters, so that on a
+ * cold cache the I/O happens in parallel rather than one open & read at a time. each file is handed to a callback as
+ * soon as it has been read, always on the calling thread (so it may go straight to a pdx::parser via span()).
+ *
+ * on Linux, opens, stats, reads, and closes are all submitted in batches through io_uring, so a whole batch costs a
+ * handful of system calls. elsewhere, or if the kernel won't give us a ring which supports those operations, a pool
+ * of reader threads does the same job with plain blocking I/O.
+ *
+ * members of a zip archive are loaded the same way, but always on a pool of threads (one per core), as inflating them
+ * is mostly CPU work. nothing is extracted to disk.
+ */
+class batch_loader {
+public:
+    enum class backend { io_uring, threads };
+
+    typedef std::function<void(loaded_file&)> callback;
+    typedef std::function<void(size_t, loaded_file&)> reader; // fill in the i-th file of a batch
+
+    static const uint MAX_IN_FLIGHT = 64; // files being read at once
+    static const uint N_THREADS     = 8;  // for the thread pool (I/O-bound, so not tied to the number of cores)
+
+private:
+    struct uring;
+    std::unique_ptr<uring> _up_ring; // null when using the thread pool
+
+    void load_uring(const std::vector<fs::path>&, const callback&);
+    void load_threads(const std::vector<fs::path>&, const callback&);
+    static void run_pool(size_t n_files, uint n_threads_max, const reader&, const callback&);
+
+public:
+    batch_loader(backend preferred = backend::io_uring);
+    batch_loader(const batch_loader&) = delete;
+    ~batch_loader();
+
+    backend active_backend() const noexcept { return (_up_ring) ? backend::io_uring : backend::threads; }
+
+    /* read every file, calling on_load for each in whatever order they complete. an exception from on_load stops the
+       batch (once any reads already under way have finished) and is rethrown. */
+    void load(const std::vector<fs::path>& paths, const callback& on_load);
+
+    /* likewise for members of a zip archive, each inflated into memory (named "archive:member"). a member which can't
+       be read (e.g., it's corrupt) gets error EBADMSG, or ENOTSUP if it's encrypted or of an unknown method. */
+    void load(const zip_archive&, const std::vector<const zip_archive::member*>& members, const callback& on_load);
+
+    /* one file, read into memory on the calling thread (throws if it can't be read) */
+    static loaded_file read(const fs::path&);
+
+    /* one member, inflated into memory on the calling thread (throws if it can't be read) */
+    static loaded_file read(const zip_archive&, const zip_archive::member&);
+};
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,50 @@
+#include "binary_file.h"
+#include "error.h"
+
+#include <string>
+#include <algorithm>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+void write_file_atomically(const fs::path& path, const std::function<bool(std::FILE*)>& write) {
+    const fs::path tmp_path = path.string() + ".tmp";
+    const std::string tmp_pathname = tmp_path.string();
+
+    {
+        file_ptr f( std::fopen(tmp_pathname.c_str(), "wb"), std::fclose );
+
+        if (f.get() == nullptr)
+            throw va_error("Could not open file for writing: %s", tmp_pathname.c_str());
+
+        if (!write(f.get()) || std::fflush(f.get()) != 0)
+            throw va_error("Could not write file: %s", tmp_pathname.c_str());
+    }
+
+    fs::rename(tmp_path, path);
+}
+
+
+bool write_magic(std::FILE* f, const file_magic& magic) {
+    return std::fwrite(magic, sizeof(magic), 1, f) == 1;
+}
+
+
+file_ptr open_with_magic(const fs::path& path, const file_magic& magic, const char* what) {
+    const std::string pathname = path.string();
+    file_ptr f( std::fopen(pathname.c_str(), "rb"), std::fclose );
+
+    if (f.get() == nullptr)
+        throw va_error("Could not open file: %s", pathname.c_str());
+
+    file_magic found;
+
+    if (std::fread(found, sizeof(found), 1, f.get()) != 1 || !std::equal(found, found + sizeof(found), magic))
+        throw va_error("Not %s: %s", what, pathname.c_str());
+
+    return f;
+}
+
+
+_PDX_NAMESPACE_END
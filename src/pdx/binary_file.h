@@ -0,0 +1,38 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <memory>
+#include <functional>
+#include <cstdio>
+#include <boost/filesystem.hpp>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* BINARY_FILE -- the plumbing shared by the files which are kept between runs (the fingerprint & directory caches,
+ * parse cache entries, snapshots, and audit state) */
+
+typedef std::unique_ptr<std::FILE, int (*)(std::FILE*)> file_ptr;
+
+/* what every such file which is read (rather than mapped) begins with, to tell its kind & format */
+typedef char file_magic[8];
+
+/* write a file by way of write(f), which returns false if any of its writes failed. it's written alongside & renamed
+   into place, so that neither an interrupted write nor any reader in the meantime can see a partial file. throws if it
+   can't be written. */
+void write_file_atomically(const fs::path&, const std::function<bool(std::FILE*)>& write);
+
+bool write_magic(std::FILE*, const file_magic&);
+
+/* open a file for reading, past its magic number, which must be the given one (else throws "Not <what>: <path>", what
+   being e.g. "a fingerprint cache") */
+file_ptr open_with_magic(const fs::path&, const file_magic&, const char* what);
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,206 @@
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "binary_lexer.h"
+#include "token.h"
+#include "error.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+static const char MAGIC[] = "CK2bin";
+static const size_t MAGIC_LEN = sizeof(MAGIC) - 1;
+
+static char YES_TEXT[] = "yes";
+static char NO_TEXT[] = "no";
+
+
+static inline uint16_t le16(const uint8_t* p) { return uint16_t(p[0] | (p[1] << 8)); }
+static inline uint32_t le32(const uint8_t* p) { return uint32_t(le16(p)) | (uint32_t(le16(p + 2)) << 16); }
+static inline uint64_t le64(const uint8_t* p) { return uint64_t(le32(p)) | (uint64_t(le32(p + 4)) << 32); }
+
+static inline int32_t clamp32(int64_t v) {
+    return (v > INT32_MAX) ? INT32_MAX : (v < INT32_MIN) ? INT32_MIN : int32_t(v);
+}
+
+
+binary_lexer::binary_lexer(const binary_input& in)
+    : _p(nullptr),
+      _end(nullptr),
+      _tokens(in.tokens),
+      _pathname(in.path.string()),
+      _location(_pathname.c_str(), size_t(0), nullptr) {
+
+    const char* pathname = _pathname.c_str();
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> f( std::fopen(pathname, "rb"), std::fclose );
+
+    if (f.get() == nullptr)
+        throw va_error("Could not open file: %s", pathname);
+
+    size_t size;
+
+    if (std::fseek(f.get(), 0, SEEK_END) != 0 || ( size = std::ftell(f.get()) ) == size_t(-1))
+        throw va_error("Could not determine size of file: %s", pathname);
+
+    std::rewind(f.get());
+    _buf = std::make_unique<char[]>(size);
+
+    if (std::fread(_buf.get(), 1, size, f.get()) != size)
+        throw va_error("Could not read file: %s", pathname);
+
+    if (size < MAGIC_LEN || memcmp(_buf.get(), MAGIC, MAGIC_LEN) != 0)
+        throw va_error("Not a binary savegame (no %s header): %s", MAGIC, pathname);
+
+    _p = _buf.get();
+    _end = _buf.get() + size;
+}
+
+
+/* consume the next n bytes of input */
+const uint8_t* binary_lexer::take(size_t n) {
+    if (size_t(_end - _p) < n)
+        throw va_error("Truncated binary token at %s (offset %zu)", _pathname.c_str(), _location._offset);
+
+    auto p = reinterpret_cast<const uint8_t*>(_p);
+    _p += n;
+    return p;
+}
+
+
+/* same as the text lexer's DATE pattern: [0-9]{1,4}\.[0-9]{1,2}\.[0-9]{1,2} */
+bool binary_lexer::is_date(const char* s, uint len) const noexcept {
+    static const uint max_digits[3] = { 4, 2, 2 };
+    const char* end = s + len;
+
+    for (uint part = 0; part < 3; ++part) {
+        uint n = 0;
+
+        for (; s < end && *s >= '0' && *s <= '9'; ++s)
+            ++n;
+
+        if (n == 0 || n > max_digits[part])
+            return false;
+
+        if (part < 2) {
+            if (s == end || *s != '.')
+                return false;
+
+            ++s;
+        }
+    }
+
+    return s == end;
+}
+
+
+bool binary_lexer::next(token* p_tok) {
+    _location._offset = _p - _buf.get();
+    p_tok->text = nullptr;
+    p_tok->len = 0;
+
+    if (_p == _end) {
+        /* EOF, so signal EOF */
+        p_tok->type = token::END;
+        return false;
+    }
+
+    if (_p == _buf.get()) {
+        /* magic header */
+        p_tok->type = token::STR;
+        p_tok->text = _p;
+        p_tok->len = MAGIC_LEN;
+        _p += MAGIC_LEN;
+        return true;
+    }
+
+    const uint16_t id = le16( take(2) );
+
+    switch (id) {
+    case EQ:
+        p_tok->type = token::EQ;
+        return true;
+
+    case OPEN:
+        p_tok->type = token::OPEN;
+        return true;
+
+    case CLOSE:
+        p_tok->type = token::CLOSE;
+        return true;
+
+    case I32:
+        p_tok->type = token::INTEGER;
+        p_tok->value = int32_t( le32(take(4)) );
+        return true;
+
+    case U32:
+        p_tok->type = token::INTEGER;
+        p_tok->value = int32_t( std::min<uint32_t>(le32(take(4)), INT32_MAX) );
+        return true;
+
+    case U64:
+        p_tok->type = token::INTEGER;
+        p_tok->value = int32_t( std::min<uint64_t>(le64(take(8)), INT32_MAX) );
+        return true;
+
+    case F32:
+        p_tok->type = token::DECIMAL;
+        p_tok->value = int32_t( le32(take(4)) );
+        return true;
+
+    case F64:
+        p_tok->type = token::DECIMAL;
+        p_tok->value = clamp32( std::llround( double(int64_t(le64(take(8)))) * 1000 / 32768 ) );
+        return true;
+
+    case BOOL:
+        p_tok->type = token::STR;
+        p_tok->text = ( *take(1) ) ? YES_TEXT : NO_TEXT;
+        p_tok->len = strlen(p_tok->text);
+        return true;
+
+    case QSTR:
+    case STR: {
+        uint len = le16( take(2) );
+        char* text = _p;
+        take(len);
+
+        if (is_date(text, len))
+            p_tok->type = (id == QSTR) ? token::QDATE : token::DATE;
+        else
+            p_tok->type = (id == QSTR) ? token::QSTR : token::STR;
+
+        p_tok->text = text;
+        p_tok->len = len;
+        return true;
+    }
+
+    default: {
+        /* anything else is a name, which should be in the table */
+        token_table::name n = _tokens[id];
+
+        if (n.text == nullptr) {
+            auto i = _unknown.find(id);
+
+            if (i == _unknown.end()) {
+                char buf[16];
+                snprintf(&buf[0], sizeof(buf), "unknown_%04x", id);
+                i = _unknown.emplace(id, buf).first;
+            }
+
+            n = token_table::name{ &i->second[0], uint(i->second.size()) };
+        }
+
+        p_tok->type = token::STR;
+        p_tok->text = n.text;
+        p_tok->len = n.len;
+        return true;
+    }
+    }
+}
+
+
+_PDX_NAMESPACE_END
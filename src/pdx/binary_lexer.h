@@ -0,0 +1,88 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+#include "file_location.h"
+#include "token_table.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+struct token;
+
+
+/* BINARY_INPUT -- a binary (ironman) savegame and the token table with which to decode it. the table must outlive the
+ * lexer. */
+
+struct binary_input {
+    fs::path path;
+    const token_table& tokens;
+};
+
+
+/* BINARY_LEXER -- a token source for binary savegames, which are a stream of little-endian 16-bit IDs: a handful of
+ * control codes for '=', braces, and typed values (each followed by its payload), and otherwise the ID of a name in
+ * the token table. there's nothing to tokenize, and numbers arrive already decoded, so they're handed to the parser
+ * that way rather than as text (see pdx::token::value). strings and names still refer to their text in-place.
+ *
+ * the leading "CK2bin" magic is passed on as a STR token, standing in for the header which savegame_policy skips.
+ * there are no line numbers in a binary file, so line() is always 0 and diagnostics should refer to offset() instead.
+ */
+class binary_lexer {
+    std::unique_ptr<char[]> _buf;
+    char* _p;
+    char* _end;
+
+    const token_table& _tokens;
+    std::unordered_map<uint16_t, std::string> _unknown; // placeholder names for IDs missing from the table
+
+    std::string _pathname;
+
+    /* position of last-lexed token */
+    file_location _location;
+
+    const uint8_t* take(size_t n);
+    bool is_date(const char* s, uint len) const noexcept;
+
+public:
+    /* binary token IDs with special meaning */
+    static const uint16_t EQ      = 0x0001;
+    static const uint16_t OPEN    = 0x0003;
+    static const uint16_t CLOSE   = 0x0004;
+    static const uint16_t I32     = 0x000c;
+    static const uint16_t F32     = 0x000d; // fixed-point, in thousandths
+    static const uint16_t BOOL    = 0x000e;
+    static const uint16_t QSTR    = 0x000f; // u16 length, then text
+    static const uint16_t U32     = 0x0014;
+    static const uint16_t STR     = 0x0017; // u16 length, then text
+    static const uint16_t F64     = 0x0167; // fixed-point, in 1/32768ths
+    static const uint16_t U64     = 0x029c;
+
+    binary_lexer() = delete;
+    binary_lexer(const binary_lexer&) = delete;
+    binary_lexer(const binary_input&);
+
+    bool next(token* p_tok);
+
+    /* not script text, so brace_index-based presizing doesn't apply */
+    const char* input() const noexcept { return nullptr; }
+    size_t input_size() const noexcept { return 0; }
+
+    const char* pathname() const noexcept { return _location.pathname(); }
+    uint line() const { return _location.line(); }
+    uint column() const { return _location.column(); }
+    size_t offset() const noexcept { return _location.offset(); }
+    const file_location& location() const noexcept { return _location; }
+};
+
+
+_PDX_NAMESPACE_END
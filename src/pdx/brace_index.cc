@@ -0,0 +1,72 @@
+
+#include "brace_index.h"
+
+#include <cstring>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+static inline bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\xA0';
+}
+
+
+/* anything which isn't whitespace and doesn't start some other kind of token continues a bareword, number, or date */
+static inline bool is_word_char(char c) {
+    return !is_space(c) && c != '{' && c != '}' && c != '=' && c != '"' && c != '#';
+}
+
+
+void brace_index::build(const char* buf, size_t sz) {
+    _v.clear();
+    _v.push_back({ 0, 0 });
+
+    std::vector<uint32_t> open; // stack of indices into _v of the currently-open braces
+    open.push_back(0);
+
+    const char* p = buf;
+    const char* end = buf + sz;
+
+    while (p < end) {
+        const char c = *p;
+
+        if (is_space(c)) {
+            ++p;
+        }
+        else if (c == '=') {
+            ++_v[ open.back() ].statements;
+            ++p;
+        }
+        else if (c == '{') {
+            ++_v[ open.back() ].elements; // a nested block is itself an element of a list of blocks
+            open.push_back( _v.size() );
+            _v.push_back({ 0, 0 });
+            ++p;
+        }
+        else if (c == '}') {
+            if (open.size() > 1) // savegames close their top level with an unmatched brace
+                open.pop_back();
+            ++p;
+        }
+        else if (c == '#') {
+            const char* eol = static_cast<const char*>( memchr(p, '\n', end - p) );
+            p = (eol) ? eol : end;
+        }
+        else if (c == '"') {
+            /* quoted strings may not span lines (an unterminated quote is a lexical error anyway) */
+            const char* q = p + 1;
+            while (q < end && *q != '"' && *q != '\n') ++q;
+
+            ++_v[ open.back() ].elements;
+            p = (q < end && *q == '"') ? q + 1 : q;
+        }
+        else {
+            ++_v[ open.back() ].elements;
+            while (++p < end && is_word_char(*p)) ;
+        }
+    }
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,41 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* brace_index -- a cheap structural pre-pass over raw script text which counts the direct children of the top level
+ * and of every brace pair, without tokenizing anything. the parser uses these counts to reserve exact capacities for
+ * blocks & lists before filling them (see parse_options::presize).
+ *
+ * since we don't yet know whether a given brace pair will turn out to be a block or a list, we count both ways: the
+ * number of '=' signs (statements of a block) and the number of values (elements of a list). the counts are only ever
+ * capacity hints, so input which the lexer will go on to reject is of no concern here.
+ */
+class brace_index {
+public:
+    struct counts {
+        uint32_t statements;
+        uint32_t elements;
+    };
+
+private:
+    std::vector<counts> _v; // [0] is the top level, and [i] is the i-th '{' in the text
+
+public:
+    void build(const char* buf, size_t sz);
+
+    size_t size() const noexcept { return _v.size(); }
+    const counts& top_level() const noexcept { return _v[0]; }
+    const counts& operator[](size_t i) const noexcept { return _v[i]; }
+};
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,26 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <cstddef>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* byte_stream -- a source of bytes which can only be read front to back, in whatever amounts suit the reader (see
+ * stream_lexer). */
+class byte_stream {
+public:
+    virtual ~byte_stream() {}
+
+    /* copy up to max_size bytes into buf, returning how many were copied (0 only once the stream is exhausted) */
+    virtual size_t read(char* buf, size_t max_size) = 0;
+
+    /* stands in for a pathname in diagnostics */
+    virtual const char* name() const noexcept = 0;
+};
+
+
+_PDX_NAMESPACE_END
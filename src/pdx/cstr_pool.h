@@ -5,9 +5,10 @@
 #include <cassert>
 #include <cstring>
 #include <cstdint>
+#include <cstddef>
 #include <stdexcept>
-#include <forward_list>
-#include <memory>
+#include <algorithm>
+#include <new>
 
 /* cstr_pool -- An efficient data structure for allocating memory for C-string style[1] sequences when sequences are
  * typically small but varied in size, and bulk, exception-safe (de)allocation is desirable.
@@ -21,78 +22,238 @@
  * faster if they start upon a 64-bit alignment boundary in RAM, but it may be desirable for compactness to reduce
  * this alignment to as low as 8-bit, since most unoptimized string algorithms already operate upon byte-by-byte
  * access patterns).
+ *
+ * Every sequence is immediately preceded by a cstr_header giving its length and a hash of it, so that length() and
+ * hash() needn't scan it (which, across the millions of strings of a big savegame, adds up).
+ *
+ * Chunks are allocated in geometrically growing sizes, from _CHUNK_SZ characters up to MAX_CHUNK_BYTES, so a pool
+ * which only ever holds a few short strings stays small while one which holds millions makes few allocations. Each
+ * chunk is a single allocation, headed by its link in the pool's chunk list. A sequence too big to share a chunk
+ * (more than a quarter of MAX_CHUNK_BYTES) is given a chunk of its own, of just the size it needs.
  */
 
 typedef unsigned char byte_t;
 
-/* note that _CHUNK_SZ is just a hint for the size in which we'd like our chunks to be allocated (bytes) */
+/* cstr_header -- what precedes every sequence in a cstr_pool (and every string in a tree image; see tree_image) */
+struct cstr_header {
+    uint32_t len;  // in characters, not counting the terminator
+    uint32_t hash; // of those characters (see cstr_pool::generic_hash)
+};
+
+/* note that _CHUNK_SZ is now the size (in characters) of just the first chunk, later ones growing from there */
 template<typename CharT = char, const size_t _CHUNK_SZ = 1024, const size_t _ALIGNMENT = alignof(CharT*)>
 class cstr_pool {
+    struct chunk {
+        chunk* p_next;
+        size_t size; // of its data, in bytes, which immediately follows
+
+        byte_t* data() noexcept { return reinterpret_cast<byte_t*>(this + 1); }
+    };
+
 public:
-    // 1 pointer overhead assumed per chunk
-    static const size_t MAX_UNALIGNED_BYTES = sizeof(CharT[_CHUNK_SZ]) - sizeof(void*);
-    static const size_t MAX_BYTES = MAX_UNALIGNED_BYTES - MAX_UNALIGNED_BYTES % _ALIGNMENT;
-    static const size_t MAX_SZ = MAX_BYTES / sizeof(CharT);
-    static_assert(MAX_BYTES % sizeof(CharT) == 0, "cstr_pool type/alignment parameters contradict each other and cannot be implemented");
+    static constexpr size_t ALIGNMENT = std::max(_ALIGNMENT, alignof(cstr_header));
+    static constexpr size_t FIRST_CHUNK_BYTES = sizeof(CharT[_CHUNK_SZ]);
+    static constexpr size_t MAX_CHUNK_BYTES = FIRST_CHUNK_BYTES << 6;
+    static constexpr size_t MAX_LEN = UINT32_MAX - 1;
 
-private:
-    struct chunk {
-        alignas(CharT) byte_t data[MAX_BYTES];
+    static_assert((ALIGNMENT & (ALIGNMENT - 1)) == 0, "cstr_pool alignment must be a power of 2");
+    static_assert(ALIGNMENT <= __STDCPP_DEFAULT_NEW_ALIGNMENT__ && sizeof(chunk) % ALIGNMENT == 0,
+                  "cstr_pool type/alignment parameters contradict each other and cannot be implemented");
+
+    /* chunk_list -- owns a singly-linked list of chunks (and so every sequence within them), which may be spliced
+     * onto another in constant time */
+    class chunk_list {
+        chunk* _p_head;
+        chunk* _p_tail;
+        size_t _size;
+
+        friend class cstr_pool;
+
+        void push_front(chunk* p) noexcept {
+            p->p_next = _p_head;
+            _p_head = p;
+
+            if (_p_tail == nullptr)
+                _p_tail = p;
+
+            ++_size;
+        }
+
+        void push_back(chunk* p) noexcept {
+            p->p_next = nullptr;
+
+            if (_p_tail)
+                _p_tail->p_next = p;
+            else
+                _p_head = p;
+
+            _p_tail = p;
+            ++_size;
+        }
+
+    public:
+        chunk_list() noexcept : _p_head(nullptr), _p_tail(nullptr), _size(0) {}
+        chunk_list(const chunk_list&) = delete;
+        chunk_list(chunk_list&& other) noexcept : chunk_list() { swap(other); }
+        chunk_list& operator=(chunk_list&& other) noexcept { chunk_list(std::move(other)).swap(*this); return *this; }
+        ~chunk_list() { clear(); }
+
+        void swap(chunk_list& other) noexcept {
+            std::swap(_p_head, other._p_head);
+            std::swap(_p_tail, other._p_tail);
+            std::swap(_size, other._size);
+        }
+
+        /* take over all of other's chunks, appending them to ours */
+        void splice(chunk_list&& other) noexcept {
+            if (other.empty())
+                return;
+
+            if (_p_tail)
+                _p_tail->p_next = other._p_head;
+            else
+                _p_head = other._p_head;
+
+            _p_tail = other._p_tail;
+            _size += other._size;
+            other._p_head = other._p_tail = nullptr;
+            other._size = 0;
+        }
+
+        void clear() noexcept {
+            while (_p_head) {
+                chunk* p_next = _p_head->p_next;
+                ::operator delete(_p_head);
+                _p_head = p_next;
+            }
+
+            _p_tail = nullptr;
+            _size = 0;
+        }
+
+        bool empty() const noexcept { return _size == 0; }
+        size_t size() const noexcept { return _size; }
     };
 
-    typedef std::forward_list<chunk> list_t; // singly-linked list, hence the 1 pointer overhead assumed
-    list_t  _chunks; // buffers
-    void*   _p; // ptr to beginning of usable buffer space
-    size_t  _capacity; // _capacity bytes remaining in _p_buf
+private:
+    chunk_list _chunks; // the one being filled (if any) is at the front; dedicated ones go to the back
+    byte_t* _p;         // ptr to beginning of usable buffer space in the front chunk
+    size_t _capacity;   // _capacity bytes remaining at _p
+    size_t _next_chunk_bytes;
 
-    void grow() {
-        _chunks.emplace_front();
-        _p = _chunks.front().data;
-        _capacity = MAX_BYTES;
+    static chunk* new_chunk(size_t size) {
+        chunk* p = static_cast<chunk*>(::operator new(sizeof(chunk) + size));
+        p->p_next = nullptr;
+        p->size = size;
+        return p;
+    }
+
+    /* room for a header & sz characters, where the characters begin at p, aligned, and the header right before them.
+       returns how many bytes from p_free that takes (0 if it doesn't fit within capacity). */
+    static size_t fit(byte_t* p_free, size_t capacity, size_t sz, CharT** p_str) noexcept {
+        const uintptr_t start = reinterpret_cast<uintptr_t>(p_free);
+        const uintptr_t str = (start + sizeof(cstr_header) + ALIGNMENT - 1) & ~uintptr_t(ALIGNMENT - 1);
+        const size_t used = (str - start) + sz * sizeof(CharT);
+
+        if (p_free == nullptr || used > capacity)
+            return 0;
+
+        *p_str = reinterpret_cast<CharT*>(str);
+        return used;
     }
 
     CharT* aligned_alloc(size_t sz) {
-        size_t sz_bytes = sz * sizeof(CharT);
-
-        if (std::align(_ALIGNMENT, sz_bytes, _p, _capacity)) {
-            /* alignment criteria satisfied!
-             * _p_buf & _capacity were modified according to alignment needs but nothing else */
-            CharT* str = reinterpret_cast<CharT*>(_p);
-            _p = (byte_t*)_p + sz_bytes;
-            _capacity -= sz_bytes;
+        CharT* str;
+        size_t used;
+
+        if (( used = fit(_p, _capacity, sz, &str) )) {
+            _p += used;
+            _capacity -= used;
+            return str;
+        }
+
+        const size_t worst = sizeof(cstr_header) + ALIGNMENT + sz * sizeof(CharT);
+
+        if (worst > MAX_CHUNK_BYTES / 4) {
+            /* too big to share a chunk: give it one of its own (leaving the front chunk to go on being filled) */
+            chunk* p = new_chunk(worst);
+            _chunks.push_back(p);
+            used = fit(p->data(), p->size, sz, &str);
+            assert(used != 0);
             return str;
         }
 
-        return nullptr;
+        /* will have to allocate a new chunk to satisfy that request */
+        chunk* p = new_chunk(std::max(_next_chunk_bytes, worst));
+        _chunks.push_front(p);
+        _next_chunk_bytes = std::min(_next_chunk_bytes * 2, MAX_CHUNK_BYTES);
+
+        used = fit(p->data(), p->size, sz, &str);
+        assert(used != 0 && "could not satisfy aligned_alloc even after allocating new chunk");
+        _p = p->data() + used;
+        _capacity = p->size - used;
+        return str;
+    }
+
+    /* (copied out, as a header needn't be aligned outside of a pool; see tree_image) */
+    static cstr_header header(const CharT* s) noexcept {
+        cstr_header hdr;
+        memcpy(&hdr, reinterpret_cast<const byte_t*>(s) - sizeof(hdr), sizeof(hdr));
+        return hdr;
     }
 
 public:
     /* provided for easy override via template specialization */
     static inline size_t generic_strlen(const CharT* s) { return strlen(s); }
 
+    /* 32-bit FNV-1a of the sequence's bytes (likewise overridable) */
+    static inline uint32_t generic_hash(const CharT* s, size_t len) {
+        const byte_t* p = reinterpret_cast<const byte_t*>(s);
+        const byte_t* end = p + len * sizeof(CharT);
+        uint32_t h = 2166136261u;
+
+        while (p != end)
+            h = (h ^ *p++) * 16777619u;
+
+        return h;
+    }
+
     /* default ctor, only ctor */
-    cstr_pool() : _p(nullptr), _capacity(0) {}
+    cstr_pool() : _p(nullptr), _capacity(0), _next_chunk_bytes(FIRST_CHUNK_BYTES) {}
+    cstr_pool(const cstr_pool&) = delete;
 
     /* strdup -- duplicate a string (allocate, copy, and return) */
-    CharT* strdup(const CharT* src) {
-        size_t len = generic_strlen(src);
-        size_t sz = len + 1;
+    CharT* strdup(const CharT* src) { return strdup(src, generic_strlen(src)); }
 
-        if (sz > MAX_SZ)
-            throw std::logic_error("cstr_pool::strdup() tried to allocate string larger than maximum chunk length");
+    /* strdup -- duplicate the first len characters of a string, which needn't be NUL-terminated */
+    CharT* strdup(const CharT* src, size_t len) {
+        if (len > MAX_LEN)
+            throw std::length_error("cstr_pool::strdup() tried to allocate string too long for its length prefix");
 
-        CharT* dst;
+        CharT* dst = aligned_alloc(len + 1);
+        cstr_header* p_hdr = reinterpret_cast<cstr_header*>(reinterpret_cast<byte_t*>(dst) - sizeof(cstr_header));
+        p_hdr->len = uint32_t(len);
+        p_hdr->hash = generic_hash(src, len);
 
-        if ((dst = aligned_alloc(sz)) == nullptr) {
-            /* will have to allocate a new chunk to satisfy that request */
-            grow();
-            dst = aligned_alloc(sz);
+        memcpy(dst, src, len * sizeof(CharT));
+        dst[len] = 0;
+        return dst;
+    }
 
-            /* should never have failed after grabbing a fresh, new chunk, because sz <= MAX_SZ */
-            assert(dst != nullptr && "could not satisfy aligned_alloc even after allocating new chunk");
-        }
+    /* length & hash -- as cached ahead of any sequence returned by strdup() (by any cstr_pool of the same CharT) */
+    static size_t length(const CharT* s) noexcept { return header(s).len; }
+    static uint32_t hash(const CharT* s) noexcept { return header(s).hash; }
 
-        memcpy(dst, src, sz * sizeof(CharT));
-        return dst;
+    /* release -- hand over every chunk allocated thus far (and so every string duplicated thus far, which stays put),
+     * leaving the pool empty but usable. nothing is copied. */
+    chunk_list release() noexcept {
+        chunk_list chunks;
+        chunks.swap(_chunks);
+        _p = nullptr;
+        _capacity = 0;
+        _next_chunk_bytes = FIRST_CHUNK_BYTES;
+        return chunks;
     }
+
+    size_t n_chunks() const noexcept { return _chunks.size(); }
 };
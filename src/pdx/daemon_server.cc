@@ -0,0 +1,198 @@
+#include "daemon_server.h"
+#include "error.h"
+
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PDX_HAVE_UNIX_SOCKETS 1
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+#ifdef PDX_HAVE_UNIX_SOCKETS
+
+static const time_t CLIENT_TIMEOUT_SEC = 10; // so that a stuck client can't wedge the server
+
+
+static sockaddr_un socket_addr(const fs::path& path) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+
+    const std::string s = path.string();
+
+    if (s.size() >= sizeof(addr.sun_path))
+        throw va_error("Socket path is too long: %s", s.c_str());
+
+    memcpy(addr.sun_path, s.c_str(), s.size());
+    return addr;
+}
+
+
+daemon_server::daemon_server(const vfs& v, const fs::path& socket_path, const fs::path& state_path)
+    : _socket_path(socket_path), _fd(-1), _quit(false), _auditor(v, state_path) {
+
+    const sockaddr_un addr = socket_addr(_socket_path);
+    const char* pathname = addr.sun_path;
+
+    /* a socket left behind by a server which is gone can be reused, but not one which is still being served */
+    if (fs::exists(_socket_path)) {
+        int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        const bool live = probe >= 0 && ::connect(probe, (const sockaddr*)&addr, sizeof(addr)) == 0;
+
+        if (probe >= 0)
+            ::close(probe);
+
+        if (live)
+            throw va_error("Another server is already listening on %s", pathname);
+
+        ::unlink(pathname);
+    }
+
+    if ((_fd = ::socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        throw va_error("Could not create socket: %s", strerror(errno));
+
+    if (::bind(_fd, (const sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(_fd, 16) != 0) {
+        const int err = errno;
+        ::close(_fd);
+        throw va_error("Could not listen on %s: %s", pathname, strerror(err));
+    }
+}
+
+
+daemon_server::~daemon_server() {
+    ::close(_fd);
+    ::unlink(_socket_path.string().c_str());
+}
+
+
+void daemon_server::run() {
+    while (!_quit) {
+        const int conn = ::accept(_fd, nullptr, nullptr);
+
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            throw va_error("Could not accept connection on %s: %s", _socket_path.string().c_str(), strerror(errno));
+        }
+
+        timeval tv = { CLIENT_TIMEOUT_SEC, 0 };
+        ::setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        ::setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        /* read lines up to the first empty one (or EOF) */
+        std::vector<std::string> request;
+        std::string line;
+        bool complete = false;
+        char buf[4096];
+        ssize_t n;
+
+        while (!complete && (n = ::recv(conn, buf, sizeof(buf), 0)) > 0) {
+            for (ssize_t i = 0; i < n && !complete; ++i) {
+                if (buf[i] == '\r')
+                    continue;
+
+                if (buf[i] != '\n') {
+                    line.push_back(buf[i]);
+                    continue;
+                }
+
+                if (line.empty())
+                    complete = true;
+                else
+                    request.push_back(std::move(line));
+
+                line.clear();
+            }
+        }
+
+        if (!line.empty())
+            request.push_back(std::move(line));
+
+        const std::string response = handle(request);
+
+        /* a client which has gone away by now is its own problem (hence no SIGPIPE) */
+        for (size_t sent = 0; sent < response.size(); ) {
+#ifdef MSG_NOSIGNAL
+            n = ::send(conn, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+#else
+            n = ::send(conn, response.data() + sent, response.size() - sent, 0);
+#endif
+            if (n <= 0)
+                break;
+
+            sent += n;
+        }
+
+        ::close(conn);
+    }
+}
+
+#else
+
+daemon_server::daemon_server(const vfs& v, const fs::path& socket_path, const fs::path& state_path)
+    : _socket_path(socket_path), _fd(-1), _quit(false), _auditor(v, state_path) {
+
+    throw va_error("Daemon mode is not supported on this platform");
+}
+
+daemon_server::~daemon_server() {}
+void daemon_server::run() {}
+
+#endif
+
+
+std::string daemon_server::handle(const std::vector<std::string>& request) {
+    std::string out;
+
+    if (request.empty())
+        return "fatal: empty request\n\n";
+
+    const std::string& cmd = request.front();
+
+    if (cmd == "quit") {
+        _quit = true;
+        return "done\n\n";
+    }
+
+    if (cmd == "status") {
+        out = "done " + std::to_string(_auditor.size()) + " files resident\n\n";
+        return out;
+    }
+
+    if (cmd != "audit")
+        return "fatal: unknown request: " + cmd + "\n\n";
+
+    const auto t0 = std::chrono::steady_clock::now();
+    uint n_reparsed = 0;
+    const uint64_t n_shared = _auditor.n_shared();
+
+    for (auto it = request.cbegin() + 1; it != request.cend(); ++it)
+        n_reparsed += _auditor.audit(*it, &out);
+
+    try {
+        _auditor.save();
+    }
+    catch (const std::exception& e) {
+        out += std::string("warning: ") + e.what() + "\n"; // (the findings stand, so the server carries on)
+    }
+
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0);
+
+    out += "done " + std::to_string(request.size() - 1) + " files, " + std::to_string(n_reparsed) + " reparsed, "
+         + std::to_string(_auditor.n_shared() - n_shared) + " shared, " + std::to_string(ms.count()) + " ms\n\n";
+
+    return out;
+}
+
+
+_PDX_NAMESPACE_END
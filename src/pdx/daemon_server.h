@@ -0,0 +1,57 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+#include "vfs.h"
+#include "file_auditor.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* DAEMON_SERVER -- keeps the vfs and every file it has been asked about resident, answering requests over a Unix
+ * domain socket, so that re-auditing a file after an edit costs only reparsing that file (and not even that if its
+ * fingerprint is unchanged) rather than a whole run's startup.
+ *
+ * one request per connection, as lines of text terminated by an empty line (or the client shutting down its end):
+ *
+ *   audit                    every following line is a virtual path to (re)audit
+ *   status                   what's resident
+ *   quit                     stop the server
+ *
+ * and likewise the response, one line per finding (see file_auditor), and then:
+ *
+ *   done <n> files, <n> reparsed, <n> shared, <n> ms   (those reparsed, of which shared another file's tree)
+ *
+ * requests are served one at a time, in order (the lexer being what it is).
+ */
+
+class daemon_server {
+    fs::path _socket_path;
+    int _fd;
+    bool _quit;
+    file_auditor _auditor;
+
+    std::string handle(const std::vector<std::string>& request);
+
+public:
+    /* bind & listen on the socket (throws if it's in use by a running server). given a state path, findings are kept
+       there between runs (see file_auditor), and saved after every audit request. */
+    daemon_server(const vfs&, const fs::path& socket_path, const fs::path& state_path = fs::path());
+    daemon_server(const daemon_server&) = delete;
+    ~daemon_server();
+
+    /* serve requests until told to quit */
+    void run();
+};
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,274 @@
+#include "dep_graph.h"
+#include "hash.h"
+#include "binary_file.h"
+#include "error.h"
+
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+static const file_magic FILE_MAGIC = { 'p', 'd', 'x', 'd', 'e', 'p', 's', '1' };
+
+
+void dep_graph::invalidate(const std::string& entity) {
+    auto it = _dependents.find(entity);
+
+    if (it == _dependents.end())
+        return;
+
+    for (const auto& id : it->second)
+        _results.at(id).valid = false;
+}
+
+
+void dep_graph::forget_file(const std::string& virtual_path) {
+    auto it = _files.find(virtual_path);
+
+    if (it == _files.end())
+        return;
+
+    for (const auto& e : it->second.entities)
+        invalidate(e);
+
+    _files.erase(it);
+}
+
+
+std::vector<fs::path> dep_graph::refresh(const vfs& v, const std::vector<fs::path>& virtual_paths) {
+    std::unordered_set<std::string> present;
+    std::vector<fs::path> stale;
+
+    for (const auto& vp : virtual_paths) {
+        vfs::location loc;
+
+        if (!v.locate(&loc, vp))
+            continue; // gone, so it'll be forgotten below
+
+        present.insert(vp.generic_string());
+
+        if (refresh(v, vp, loc))
+            stale.push_back(vp);
+    }
+
+    std::vector<std::string> gone;
+
+    for (const auto& f : _files)
+        if (present.count(f.first) == 0)
+            gone.push_back(f.first);
+
+    for (const auto& name : gone)
+        forget_file(name);
+
+    return stale;
+}
+
+
+uint64_t dep_graph::file_hash(const vfs& v, const vfs::location& loc) {
+    const std::string real_pathname = loc.real_path.string();
+    return hash64(real_pathname.data(), real_pathname.size(), v.content_hash(loc));
+}
+
+
+bool dep_graph::refresh(const vfs& v, const fs::path& virtual_path, const vfs::location& loc) {
+    const std::string name = virtual_path.generic_string();
+    const uint64_t hash = file_hash(v, loc);
+    auto it = _files.find(name);
+
+    if (it != _files.end() && it->second.hash == hash)
+        return false;
+
+    forget_file(name);
+    _files[name].hash = hash;
+    define(virtual_path, GAME_FILE, name);
+    return true;
+}
+
+
+void dep_graph::define(const fs::path& virtual_path, entity_kind kind, const std::string& name) {
+    std::string k = key(kind, name);
+    invalidate(k);
+    _files[virtual_path.generic_string()].entities.push_back(std::move(k));
+}
+
+
+const std::string* dep_graph::result(const std::string& id) const {
+    auto it = _results.find(id);
+    return (it != _results.end() && it->second.valid) ? &it->second.value : nullptr;
+}
+
+
+void dep_graph::unlink(const std::string& id, const result_rec& r) {
+    for (const auto& d : r.deps) {
+        auto it = _dependents.find(d);
+
+        if (it != _dependents.end() && it->second.erase(id) && it->second.empty())
+            _dependents.erase(it);
+    }
+}
+
+
+void dep_graph::set(const std::string& id, const std::string& value, const std::vector<std::string>& deps) {
+    result_rec& r = _results[id];
+    unlink(id, r);
+
+    r.value = value;
+    r.deps = deps;
+    r.valid = true;
+
+    for (const auto& d : r.deps)
+        _dependents[d].insert(id);
+}
+
+
+void dep_graph::erase(const std::string& id) {
+    auto it = _results.find(id);
+
+    if (it == _results.end())
+        return;
+
+    unlink(id, it->second);
+    _results.erase(it);
+}
+
+
+std::vector<std::string> dep_graph::invalid_results() const {
+    std::vector<std::string> ids;
+
+    for (const auto& r : _results)
+        if (!r.second.valid)
+            ids.push_back(r.first);
+
+    return ids;
+}
+
+
+/* STATE FILE
+ *
+ * a magic number, then the files (each its virtual path, content hash, and the keys it defined) and the results (each
+ * its ID, value, validity, and the keys it depended upon), all counted & all strings length-prefixed. host byte order,
+ * like the fingerprint cache on whose hashes it depends.
+ */
+
+static bool write_u32(std::FILE* f, uint32_t u) { return std::fwrite(&u, sizeof(u), 1, f) == 1; }
+static bool write_u64(std::FILE* f, uint64_t u) { return std::fwrite(&u, sizeof(u), 1, f) == 1; }
+
+static bool write_str(std::FILE* f, const std::string& s) {
+    return write_u32(f, uint32_t(s.size())) && std::fwrite(s.data(), 1, s.size(), f) == s.size();
+}
+
+static bool write_strs(std::FILE* f, const std::vector<std::string>& v) {
+    bool ok = write_u32(f, uint32_t(v.size()));
+
+    for (auto it = v.cbegin(); ok && it != v.cend(); ++it)
+        ok = write_str(f, *it);
+
+    return ok;
+}
+
+static bool read_u32(std::FILE* f, uint32_t* p) { return std::fread(p, sizeof(*p), 1, f) == 1; }
+static bool read_u64(std::FILE* f, uint64_t* p) { return std::fread(p, sizeof(*p), 1, f) == 1; }
+
+static bool read_str(std::FILE* f, std::string* p) {
+    uint32_t len;
+
+    if (!read_u32(f, &len))
+        return false;
+
+    p->resize(len);
+    return std::fread(&(*p)[0], 1, len, f) == len;
+}
+
+static bool read_strs(std::FILE* f, std::vector<std::string>* p) {
+    uint32_t n;
+
+    if (!read_u32(f, &n))
+        return false;
+
+    p->clear();
+
+    for (uint32_t i = 0; i < n; ++i) {
+        std::string s;
+
+        if (!read_str(f, &s))
+            return false;
+
+        p->push_back(std::move(s));
+    }
+
+    return true;
+}
+
+
+void dep_graph::save(const fs::path& path) const {
+    /* (written alongside & renamed into place, so that an interrupted save can't leave a truncated state file) */
+    write_file_atomically(path, [&](std::FILE* f) {
+        bool ok = write_magic(f, FILE_MAGIC) && write_u64(f, _files.size());
+
+        for (auto it = _files.cbegin(); ok && it != _files.cend(); ++it)
+            ok = write_str(f, it->first) && write_u64(f, it->second.hash)
+              && write_strs(f, it->second.entities);
+
+        ok = ok && write_u64(f, _results.size());
+
+        for (auto it = _results.cbegin(); ok && it != _results.cend(); ++it)
+            ok = write_str(f, it->first) && write_str(f, it->second.value)
+              && write_u32(f, it->second.valid) && write_strs(f, it->second.deps);
+
+        return ok;
+    });
+}
+
+
+void dep_graph::load(const fs::path& path) {
+    const std::string pathname = path.string();
+    file_ptr f = open_with_magic(path, FILE_MAGIC, "an audit state file");
+
+    _files.clear();
+    _results.clear();
+    _dependents.clear();
+
+    uint64_t n;
+    bool ok = read_u64(f.get(), &n);
+
+    for (uint64_t i = 0; ok && i < n; ++i) {
+        std::string name;
+        file_rec rec;
+        ok = read_str(f.get(), &name) && read_u64(f.get(), &rec.hash) && read_strs(f.get(), &rec.entities);
+
+        if (ok)
+            _files.emplace(std::move(name), std::move(rec));
+    }
+
+    ok = ok && read_u64(f.get(), &n);
+
+    for (uint64_t i = 0; ok && i < n; ++i) {
+        std::string id;
+        result_rec rec;
+        uint32_t valid;
+        ok = read_str(f.get(), &id) && read_str(f.get(), &rec.value) && read_u32(f.get(), &valid)
+          && read_strs(f.get(), &rec.deps);
+
+        if (ok) {
+            rec.valid = valid;
+
+            for (const auto& d : rec.deps)
+                _dependents[d].insert(id);
+
+            _results.emplace(std::move(id), std::move(rec));
+        }
+    }
+
+    if (!ok) {
+        _files.clear();
+        _results.clear();
+        _dependents.clear();
+        throw va_error("Truncated audit state file: %s", pathname.c_str());
+    }
+}
+
+
+_PDX_NAMESPACE_END
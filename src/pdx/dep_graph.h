@@ -0,0 +1,109 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+#include "vfs.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* DEP_GRAPH -- the state of an incremental audit: which entities (titles, characters, events, localisation keys, ...)
+ * each game file defined when it was last parsed, and which entities each audit result was derived from, so that after
+ * some files change only those need reparsing and only the results which depended on them need re-evaluating.
+ *
+ * a rerun goes:
+ *
+ *   1. refresh() with every file of interest. files whose content (by vfs fingerprint) or real path has changed since
+ *      they were recorded -- or which have appeared or disappeared -- are forgotten, invalidating every result which
+ *      depended on anything they defined. the changed files which still exist are returned.
+ *   2. reparse just those, define()-ing each entity found in them anew (which in turn invalidates any result which
+ *      depended on that entity, e.g. one which had found it to be missing).
+ *   3. re-evaluate each result whose result() is null, set()-ing it along with everything it looked at.
+ *
+ * and the whole thing may be saved & loaded between runs. entities are identified by kind & name (see key()), and
+ * every file is implicitly an entity of kind GAME_FILE which it defines itself, for results which depend on a file as
+ * such.
+ */
+
+class dep_graph {
+public:
+    enum entity_kind : char {
+        GAME_FILE = 'f',
+        TITLE     = 't',
+        CHARACTER = 'c',
+        EVENT     = 'e',
+        LOC_KEY   = 'l',
+    };
+
+    static std::string key(entity_kind kind, const std::string& name) { return std::string(1, kind) + ':' + name; }
+
+private:
+    struct file_rec {
+        uint64_t hash;
+        std::vector<std::string> entities; // keys of what it defined
+    };
+
+    struct result_rec {
+        std::string value;
+        std::vector<std::string> deps; // entity keys
+        bool valid;
+    };
+
+    std::unordered_map<std::string, file_rec> _files; // by virtual path (generic form)
+    std::unordered_map<std::string, result_rec> _results;
+    std::unordered_map<std::string, std::unordered_set<std::string>> _dependents; // entity key -> result IDs
+
+    void invalidate(const std::string& entity);
+    void unlink(const std::string& id, const result_rec&);
+    void forget_file(const std::string& virtual_path);
+
+public:
+    /* bring the recorded files up to date with their current content, returning those which must be reparsed */
+    std::vector<fs::path> refresh(const vfs&, const std::vector<fs::path>& virtual_paths);
+
+    /* ...or just the one, as located. true if it must be reparsed, i.e. it wasn't recorded with its file_hash(). */
+    bool refresh(const vfs&, const fs::path& virtual_path, const vfs::location&);
+
+    /* what a file is recorded by: its content hash, with its real path folded in (as a fatal parse error's message
+       names it, so a result may depend on that too) */
+    static uint64_t file_hash(const vfs&, const vfs::location&);
+
+    /* forget a file which has gone, invalidating every result which depended on anything it defined */
+    void forget(const fs::path& virtual_path) { forget_file(virtual_path.generic_string()); }
+
+    /* record that a (re)parsed file defines an entity */
+    void define(const fs::path& virtual_path, entity_kind kind, const std::string& name);
+
+    /* the value of a result if it's known & still valid, else null */
+    const std::string* result(const std::string& id) const;
+
+    /* record a result's value & the keys of all entities it was derived from */
+    void set(const std::string& id, const std::string& value, const std::vector<std::string>& deps);
+
+    /* forget a result which no longer applies (e.g., its subject has gone) */
+    void erase(const std::string& id);
+
+    /* IDs of known results which have been invalidated */
+    std::vector<std::string> invalid_results() const;
+
+    size_t n_files() const noexcept   { return _files.size(); }
+    size_t n_results() const noexcept { return _results.size(); }
+
+    void save(const fs::path& path) const;
+    void load(const fs::path& path);
+};
+
+
+_PDX_NAMESPACE_END
@@ -24,6 +24,7 @@ struct error {
     error(priority prio, const file_location& location, const char* format, Args&&... args)
         : _prio(prio), _location(location)
     {
+        _location.resolve();
         snprintf(&_msg[0], sizeof(_msg), format, std::forward<Args>(args)...);
     }
 
@@ -31,6 +32,7 @@ struct error {
     error(const file_location& location, const char* format, Args&&... args)
         : _prio(priority::NORMAL), _location(location)
     {
+        _location.resolve();
         snprintf(&_msg[0], sizeof(_msg), format, std::forward<Args>(args)...);
     }
 
@@ -0,0 +1,157 @@
+#include "file_auditor.h"
+#include "hash.h"
+#include "error.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* the ID of a file's findings in the dep_graph */
+static std::string findings_id(const std::string& virtual_path) { return "findings:" + virtual_path; }
+
+
+static bool in_dir(const std::string& virtual_path, const char* dir) {
+    const size_t n = strlen(dir);
+
+    return virtual_path.size() > n && std::equal(dir, dir + n, virtual_path.begin(), [](char a, char b) {
+        return a == ::tolower(static_cast<unsigned char>(b));
+    });
+}
+
+
+static void define_titles(dep_graph* p_deps, const fs::path& virtual_path, const block& b) {
+    for (const auto& s : b) {
+        if (s.key().is_string() && s.value().is_block() && looks_like_title(s.key().as_string())) {
+            p_deps->define(virtual_path, dep_graph::TITLE, s.key().as_string());
+            define_titles(p_deps, virtual_path, *s.value().as_block());
+        }
+    }
+}
+
+
+/* record the entities which a file defines, by where it is: the titles of a landed_titles file (at any depth), the
+   events of an events file, and the characters of a character history file. (localisation isn't script.) */
+static void define_entities(dep_graph* p_deps, const fs::path& virtual_path, const block& root) {
+    const std::string name = virtual_path.generic_string();
+
+    if (in_dir(name, "common/landed_titles/")) {
+        define_titles(p_deps, virtual_path, root);
+    }
+    else if (in_dir(name, "events/")) {
+        for (const auto& s : root) {
+            if (!s.value().is_block())
+                continue;
+
+            for (const auto& e : *s.value().as_block()) {
+                if (e.key() == "id" && (e.value().is_string() || e.value().is_integer())) {
+                    const std::string id = (e.value().is_string()) ? e.value().as_string()
+                                                                    : std::to_string(e.value().as_integer());
+                    p_deps->define(virtual_path, dep_graph::EVENT, id);
+                    break;
+                }
+            }
+        }
+    }
+    else if (in_dir(name, "history/characters/")) {
+        for (const auto& s : root)
+            if (s.key().is_integer() && s.value().is_block())
+                p_deps->define(virtual_path, dep_graph::CHARACTER, std::to_string(s.key().as_integer()));
+    }
+}
+
+
+file_auditor::file_auditor(const vfs& v, const fs::path& state_path) : _vfs(v), _state_path(state_path) {
+    if (!_state_path.empty() && fs::exists(_state_path))
+        _deps.load(_state_path);
+}
+
+
+void file_auditor::forget(const fs::path& virtual_path) {
+    const std::string name = virtual_path.generic_string();
+    _files.erase(name);
+    _deps.forget(virtual_path);
+    _deps.erase(findings_id(name));
+}
+
+
+void file_auditor::save() const {
+    if (!_state_path.empty())
+        _deps.save(_state_path);
+}
+
+
+bool file_auditor::audit(const fs::path& virtual_path, std::string* p_out) {
+    const std::string name = virtual_path.generic_string();
+    const std::string id = findings_id(name);
+    std::string& out = *p_out;
+    std::string findings;
+    vfs::location loc;
+
+    try {
+        if (!_vfs.locate(&loc, virtual_path))
+            throw va_error("Missing game file");
+
+        if (loc.case_mismatch)
+            findings += "warning " + name + ": differs in case from " + loc.real_path.string() + "\n";
+
+        /* only a changed stamp (size & mtime) gets as far as rehashing, and only a changed hash (or real path) gets
+           reparsed */
+        const bool stale = _deps.refresh(_vfs, virtual_path, loc);
+        const std::string* p_findings = (stale) ? nullptr : _deps.result(id);
+
+        if (p_findings) {
+            out += findings + *p_findings;
+            return false;
+        }
+
+        _files.erase(name);
+
+        /* (hashed afresh, as an archive member's content_hash is only a CRC) */
+        loaded_file loaded = (loc.p_member) ? batch_loader::read(*loc.p_archive, *loc.p_member)
+                                            : batch_loader::read(loc.real_path);
+        const uint64_t content_hash = hash64(loaded.data.get(), loaded.size);
+        parsed_file file;
+        std::string result;
+
+        if (!_trees.find(&file, content_hash)) {
+            try {
+                file = parsed_file::parse(std::move(loaded));
+                _trees.add(content_hash, file);
+            }
+            catch (const std::exception& e) {
+                result = "fatal " + name + ": " + e.what() + "\n"; // (recorded, as it'll be the same until it changes)
+            }
+        }
+
+        if (file.root_block()) {
+            const error_queue& errors = file.errors();
+
+            if (errors.empty())
+                result += "ok " + name + "\n";
+
+            for (auto&& e : errors)
+                result += "error " + name + ":L" + std::to_string(e._location.line()) + ": " + e.what() + "\n";
+
+            define_entities(&_deps, virtual_path, *file.root_block());
+            _files[name] = std::move(file);
+        }
+
+        _deps.set(id, result, { dep_graph::key(dep_graph::GAME_FILE, name) });
+        findings += result;
+    }
+    catch (const std::exception& e) {
+        forget(virtual_path);
+        out += "fatal " + name + ": " + e.what() + "\n";
+        return true;
+    }
+
+    out += findings;
+    return true;
+}
+
+
+_PDX_NAMESPACE_END
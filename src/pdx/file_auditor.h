@@ -0,0 +1,65 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+#include "vfs.h"
+#include "parse_cache.h"
+#include "dep_graph.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* FILE_AUDITOR -- audits game files by virtual path, keeping each one's tree resident so that auditing it again costs
+ * nothing unless its content has changed since (per its fingerprint, which only a changed size or mtime gets as far
+ * as rehashing). a file which has to be parsed, but whose content is the same as a resident one's (e.g., a mod's
+ * verbatim copy of a base game file), shares that one's tree instead (see tree_share). shared by the long-running
+ * frontends (daemon_server, watcher).
+ *
+ * each file's findings are also recorded in a dep_graph, along with the entities it defines (its titles, events, or
+ * characters). given a state path, the graph is loaded from there (if it exists) and save() writes it back, so that
+ * a later run reuses the findings of every file whose content (by fingerprint) and real path are as they were,
+ * without parsing it at all (and without its tree being resident, until it changes).
+ *
+ * findings are appended one per line:
+ *
+ *   ok <path>
+ *   warning <path>: <message>         (e.g., the path only matched case-insensitively; see vfs::index_paths)
+ *   error <path>:L<line>: <message>   (non-fatal parse errors)
+ *   fatal <path>: <message>           (the file couldn't be parsed, or couldn't be found)
+ */
+
+class file_auditor {
+    const vfs& _vfs;
+    std::unordered_map<std::string, parsed_file> _files; // by virtual path (generic form)
+    tree_share _trees;
+    dep_graph _deps;
+    fs::path _state_path;
+
+public:
+    file_auditor(const vfs&, const fs::path& state_path = fs::path());
+
+    /* (re)audit a file, appending its findings to *p_out. true if it had to be parsed (or was given a shared tree). */
+    bool audit(const fs::path& virtual_path, std::string* p_out);
+
+    /* drop a file's tree & findings (e.g., it's gone) */
+    void forget(const fs::path& virtual_path);
+
+    /* write the dep_graph to the state path, if given */
+    void save() const;
+
+    size_t size() const noexcept { return _files.size(); } // of trees resident
+    uint64_t n_shared() const noexcept { return _trees.n_hits(); } // files given another's tree, thus far
+};
+
+
+_PDX_NAMESPACE_END
@@ -3,19 +3,39 @@
 #pragma once
 #include "pdx_common.h"
 
+#include <cstddef>
+
+#include "line_index.h"
+
 
 _PDX_NAMESPACE_BEGIN
 
 
+/* file_location -- either a known line number or a byte offset whose line number is computed on demand by the
+ * lexer's line_resolver (usually its line_index). resolve() turns the latter into the former, which must happen before a location may outlive the
+ * lexer which produced it (see pdx::error). */
 struct file_location {
     const char* _pathname;
+    size_t _offset;
+    const line_resolver* _p_lines; // null once resolved (or when constructed with an explicit line)
     uint _line;
 
     file_location() = delete;
-    file_location(const char* path, uint line) : _pathname(path), _line(line) {}
+    file_location(const char* path, uint line) : _pathname(path), _offset(0), _p_lines(nullptr), _line(line) {}
+    file_location(const char* path, size_t offset, const line_resolver* p_lines)
+        : _pathname(path), _offset(offset), _p_lines(p_lines), _line(0) {}
 
     const char* pathname() const noexcept { return _pathname; }
-    uint line() const noexcept { return _line; }
+    size_t offset() const noexcept { return _offset; }
+    uint line() const { return (_p_lines) ? _p_lines->line(_offset) : _line; }
+    uint column() const { return (_p_lines) ? _p_lines->column(_offset) : 0; }
+
+    void resolve() {
+        if (_p_lines) {
+            _line = _p_lines->line(_offset);
+            _p_lines = nullptr;
+        }
+    }
 };
 
 
@@ -0,0 +1,65 @@
+
+#include "file_stream.h"
+#include "error.h"
+
+#include <memory>
+#include <cstdio>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#endif
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+file_stream::file_stream(const fs::path& path)
+    : async_stream(CHUNK_SZ, N_CHUNKS),
+      _pathname(path.string()) {
+
+    start();
+}
+
+
+file_stream::~file_stream() {
+    stop();
+}
+
+
+void file_stream::produce() {
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> f( std::fopen(_pathname.c_str(), "rb"), std::fclose );
+
+    if (f.get() == nullptr)
+        throw va_error("Could not open file: %s", _pathname.c_str());
+
+    /* our reads are already as large as they get, so stdio's buffering would only cost us an extra copy */
+    std::setvbuf(f.get(), nullptr, _IONBF, 0);
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    /* widens the kernel's own readahead window (advice only, so failure is of no consequence) */
+    posix_fadvise(fileno(f.get()), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    while (1) {
+        char* buf = acquire();
+
+        if (buf == nullptr)
+            return; // cancelled
+
+        size_t n = std::fread(buf, 1, chunk_sz(), f.get());
+
+        if (n < chunk_sz() && std::ferror(f.get()))
+            throw va_error("Could not read file: %s", _pathname.c_str());
+
+        if (n == 0)
+            return; // EOF
+
+        publish(n);
+
+        if (n < chunk_sz())
+            return; // EOF
+    }
+}
+
+
+_PDX_NAMESPACE_END
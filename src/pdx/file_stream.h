@@ -0,0 +1,44 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <boost/filesystem.hpp>
+
+#include "async_stream.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* file_stream -- a file as a byte_stream, read ahead of the reader in large chunks on a thread of its own (see
+ * async_stream), so that on a cold page cache, lexing one chunk overlaps with waiting on the disk for the next rather
+ * than stalling on every read. the kernel is told we'll read the file sequentially, where it supports such advice.
+ *
+ * pdx::lexer reads a whole file before lexing any of it; for big files, a stream_lexer over a file_stream gets going
+ * sooner and needs no more than N_CHUNKS * CHUNK_SZ of memory for its input.
+ */
+class file_stream final : public async_stream {
+public:
+    static const size_t CHUNK_SZ = 4 << 20;
+    static const uint   N_CHUNKS = 3;
+
+private:
+    std::string _pathname;
+
+    void produce() override;
+
+public:
+    file_stream() = delete;
+    file_stream(const fs::path&);
+    ~file_stream();
+
+    const char* name() const noexcept override { return _pathname.c_str(); }
+};
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,205 @@
+#include "fingerprint.h"
+#include "hash.h"
+#include "batch_loader.h"
+#include "binary_file.h"
+#include "error.h"
+
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <cstdio>
+
+#ifdef __linux__
+#include <sys/stat.h>
+#endif
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+static const file_magic FILE_MAGIC = { 'p', 'd', 'x', 'f', 'p', 'r', 't', '1' };
+
+
+fingerprint stamp_file(const fs::path& real_path) {
+    fingerprint fp;
+    fp.hash = 0;
+    fp.has_hash = false;
+
+#ifdef __linux__
+    struct stat st;
+
+    if (::stat(real_path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        throw va_error("Could not stat file: %s", real_path.c_str());
+
+    fp.size = uint64_t(st.st_size);
+    fp.mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    boost::system::error_code ec;
+    fp.size = fs::file_size(real_path, ec);
+
+    if (!ec)
+        fp.mtime = int64_t(fs::last_write_time(real_path, ec)) * 1000000000;
+
+    if (ec)
+        throw va_error("Could not stat file: %s", real_path.string().c_str());
+#endif
+
+    return fp;
+}
+
+
+const fingerprint& fingerprint_cache::stamp(const fs::path& real_path) {
+    fingerprint now = stamp_file(real_path);
+    auto it = _map.find(real_path.string());
+
+    if (it == _map.end())
+        return _map.emplace(real_path.string(), now).first->second;
+
+    if (!it->second.same_stamp(now))
+        it->second = now;
+
+    return it->second;
+}
+
+
+const fingerprint& fingerprint_cache::get(const fs::path& real_path) {
+    const fingerprint& fp = stamp(real_path);
+
+    if (!fp.has_hash)
+        hash_all({ real_path });
+
+    return fp;
+}
+
+
+void fingerprint_cache::hash_all(const std::vector<fs::path>& real_paths) {
+    std::vector<fs::path> stale;
+
+    for (const auto& p : real_paths)
+        if (!stamp(p).has_hash)
+            stale.push_back(p);
+
+    if (stale.empty())
+        return;
+
+    batch_loader loader;
+
+    loader.load(stale, [this](loaded_file& f) {
+        if (f.error)
+            throw va_error("Could not read file: %s", f.pathname.c_str());
+
+        fingerprint& fp = _map.at(f.pathname);
+
+        if (f.size != fp.size) {
+            /* changed since we stamped it, so what we read goes with a new stamp */
+            fp = stamp_file(f.pathname);
+        }
+
+        fp.hash = hash64(f.data.get(), f.size);
+        fp.has_hash = true;
+        ++_n_files_hashed;
+    });
+}
+
+
+uint64_t fingerprint_cache::tree_hash(const fs::path& root) {
+    std::vector<fs::path> paths;
+
+    for (fs::recursive_directory_iterator it(root), end; it != end; ++it)
+        if (fs::is_regular_file(it->status()))
+            paths.push_back(it->path());
+
+    hash_all(paths);
+
+    std::vector<std::pair<std::string, uint64_t>> entries;
+    entries.reserve(paths.size());
+
+    for (const auto& p : paths)
+        entries.emplace_back(p.lexically_relative(root).generic_string(), _map.at(p.string()).hash);
+
+    /* directory iteration order is arbitrary, but the result mustn't be */
+    std::sort(entries.begin(), entries.end());
+
+    uint64_t h = hash64(nullptr, 0);
+
+    for (const auto& e : entries) {
+        h = hash64(e.first.c_str(), e.first.size() + 1, h); // with NUL, so that path & hash can't run together
+        h = hash64(&e.second, sizeof(e.second), h);
+    }
+
+    return h;
+}
+
+
+/* CACHE FILE
+ *
+ * a magic number, an entry count, and then for each entry its path (length-prefixed), size, mtime, and hash. all in
+ * host byte order, since a cache of local file metadata is of no use on another machine anyway.
+ */
+
+void fingerprint_cache::save(const fs::path& path) const {
+    /* (written alongside & renamed into place, so that an interrupted save can't leave a truncated cache) */
+    write_file_atomically(path, [&](std::FILE* f) {
+        uint64_t n = 0;
+
+        for (const auto& e : _map)
+            if (e.second.has_hash)
+                ++n;
+
+        bool ok = write_magic(f, FILE_MAGIC) && std::fwrite(&n, sizeof(n), 1, f) == 1;
+
+        for (auto it = _map.begin(); ok && it != _map.end(); ++it) {
+            const fingerprint& fp = it->second;
+
+            if (!fp.has_hash)
+                continue;
+
+            const uint32_t len = uint32_t(it->first.size());
+
+            ok = std::fwrite(&len, sizeof(len), 1, f) == 1
+              && std::fwrite(it->first.data(), 1, len, f) == len
+              && std::fwrite(&fp.size, sizeof(fp.size), 1, f) == 1
+              && std::fwrite(&fp.mtime, sizeof(fp.mtime), 1, f) == 1
+              && std::fwrite(&fp.hash, sizeof(fp.hash), 1, f) == 1;
+        }
+
+        return ok;
+    });
+}
+
+
+void fingerprint_cache::load(const fs::path& path) {
+    const std::string pathname = path.string();
+    file_ptr f = open_with_magic(path, FILE_MAGIC, "a fingerprint cache");
+
+    uint64_t n;
+
+    if (std::fread(&n, sizeof(n), 1, f.get()) != 1)
+        throw va_error("Truncated fingerprint cache: %s", pathname.c_str());
+
+    std::string key;
+
+    for (uint64_t i = 0; i < n; ++i) {
+        uint32_t len;
+        fingerprint fp;
+
+        if (std::fread(&len, sizeof(len), 1, f.get()) != 1)
+            throw va_error("Truncated fingerprint cache: %s", pathname.c_str());
+
+        key.resize(len);
+
+        if (std::fread(&key[0], 1, len, f.get()) != len
+            || std::fread(&fp.size, sizeof(fp.size), 1, f.get()) != 1
+            || std::fread(&fp.mtime, sizeof(fp.mtime), 1, f.get()) != 1
+            || std::fread(&fp.hash, sizeof(fp.hash), 1, f.get()) != 1)
+            throw va_error("Truncated fingerprint cache: %s", pathname.c_str());
+
+        fp.has_hash = true;
+
+        /* what we've stamped this run is at least as fresh as what's on disk */
+        _map.emplace(key, fp);
+    }
+}
+
+
+_PDX_NAMESPACE_END
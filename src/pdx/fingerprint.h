@@ -0,0 +1,71 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* fingerprint -- what we know of a file's identity. size & mtime are cheap (one stat) and are trusted to mean the
+ * content hasn't changed for as long as neither changes; the content hash is only computed on demand. */
+struct fingerprint {
+    uint64_t size;
+    int64_t mtime;  // nanoseconds since the epoch (or coarser, where the platform doesn't offer better)
+    uint64_t hash;  // hash64 of the file's content, when has_hash
+    bool has_hash;
+
+    bool same_stamp(const fingerprint& o) const noexcept { return size == o.size && mtime == o.mtime; }
+};
+
+
+/* just the size & mtime of a regular file (throws if it can't be stat'd) */
+fingerprint stamp_file(const fs::path& real_path);
+
+
+/* fingerprint_cache -- fingerprints of real files, keyed by path, suitable for use as cache keys by anything which
+ * derives data from game files. a file is only read (to hash it) when it has never been hashed or when its size or
+ * mtime has changed since it was, and the cache may be saved & reloaded so that holds across runs too.
+ *
+ * (a file rewritten with the same size within the mtime's granularity of when it was hashed will go unnoticed; with
+ * nanosecond mtimes, that's not a concern in practice.)
+ */
+class fingerprint_cache {
+    std::unordered_map<std::string, fingerprint> _map;
+    uint64_t _n_files_hashed;
+
+public:
+    fingerprint_cache() : _n_files_hashed(0) {}
+
+    /* stat the file & update its entry, keeping any hash for it if size & mtime are as they were */
+    const fingerprint& stamp(const fs::path& real_path);
+
+    /* as stamp(), then hash the content if need be */
+    const fingerprint& get(const fs::path& real_path);
+
+    /* stamp every file & hash those which need it, reading them in parallel */
+    void hash_all(const std::vector<fs::path>& real_paths);
+
+    /* a hash over the relative paths & content hashes of every regular file beneath root (hashing them as needed), so
+       it changes whenever any file in the tree is added, removed, renamed, or changed */
+    uint64_t tree_hash(const fs::path& root);
+
+    /* persist the hashed entries to a file / merge them back in (stale ones are dropped by the next stamp()) */
+    void save(const fs::path& path) const;
+    void load(const fs::path& path);
+
+    size_t size() const noexcept { return _map.size(); }
+    uint64_t n_files_hashed() const noexcept { return _n_files_hashed; } // files actually read, over our lifetime
+};
+
+
+_PDX_NAMESPACE_END
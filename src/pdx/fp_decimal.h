@@ -46,6 +46,10 @@ public:
     fp_decimal(float f)  : _m( f * scale + 0.5f ) {}
     fp_decimal(int i)    : _m( i * scale ) {}
 
+    /* from the representation itself, i.e. the value times scale */
+    static self_t from_scaled(int32_t m) noexcept { self_t r(0); r._m = m; return r; }
+
+    int32_t scaled()     const noexcept { return _m; }
     int32_t integral()   const noexcept { return _m / scale; }
     int32_t fractional() const noexcept { return _m % scale; }
 
@@ -0,0 +1,19 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <cstddef>
+#include <cstdint>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* hash64 -- a fast 64-bit non-cryptographic hash of a byte sequence (XXH64, so it runs at close to memory bandwidth
+ * and agrees with any other XXH64 implementation). the result of hashing one sequence may be passed as the seed for
+ * the next in order to hash several as one. */
+uint64_t hash64(const void* data, size_t size, uint64_t seed = 0) noexcept;
+
+
+_PDX_NAMESPACE_END
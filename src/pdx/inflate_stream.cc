@@ -0,0 +1,124 @@
+
+#include "inflate_stream.h"
+#include "error.h"
+
+#include <algorithm>
+#include <memory>
+#include <cstring>
+#include <zlib.h>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* the archive must outlive the stream */
+inflate_stream::inflate_stream(const zip_archive& archive, const zip_archive::member& m)
+    : async_stream(CHUNK_SZ, N_CHUNKS),
+      _archive(archive),
+      _member(m),
+      _name(archive.pathname() + ":" + m.name) {
+
+    if (m.flags & 0x1)
+        throw va_error("Encrypted zip archive members are not supported: %s", _name.c_str());
+
+    if (m.method != zip_archive::STORED && m.method != zip_archive::DEFLATED)
+        throw va_error("Unsupported zip compression method %u: %s", m.method, _name.c_str());
+
+    start();
+}
+
+
+inflate_stream::~inflate_stream() {
+    stop();
+}
+
+
+void inflate_stream::produce() {
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> f( std::fopen(_archive.pathname().c_str(), "rb"), std::fclose );
+
+    if (f.get() == nullptr)
+        throw va_error("Could not open file: %s", _archive.pathname().c_str());
+
+    if (std::fseek(f.get(), _archive.data_offset(f.get(), _member), SEEK_SET) != 0)
+        throw va_error("Could not read zip archive member: %s", _name.c_str());
+
+    decompress(f.get());
+}
+
+
+void inflate_stream::decompress(std::FILE* f) {
+    const bool stored = (_member.method == zip_archive::STORED);
+    auto input = std::make_unique<unsigned char[]>(INPUT_SZ);
+    size_t input_left = _member.compressed_size; // compressed bytes not yet read from the file
+
+    /* a negative window size selects raw deflate data, without any zlib header/trailer (zip has its own) */
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+
+    if (!stored && inflateInit2(&z, -MAX_WBITS) != Z_OK)
+        throw va_error("Could not initialize zlib: %s", _name.c_str());
+
+    std::unique_ptr<z_stream, int (*)(z_stream*)> z_guard( (stored) ? nullptr : &z, inflateEnd );
+
+    uLong crc = crc32(0, Z_NULL, 0);
+    uint64_t size = 0;
+    bool end = false;
+
+    while (!end) {
+        char* out = acquire();
+
+        if (out == nullptr)
+            return; // cancelled
+
+        size_t out_sz = 0;
+
+        if (stored) {
+            out_sz = std::min(CHUNK_SZ, input_left);
+
+            if (std::fread(out, 1, out_sz, f) != out_sz)
+                throw va_error("Truncated zip archive member: %s", _name.c_str());
+
+            input_left -= out_sz;
+            end = (input_left == 0);
+        }
+        else {
+            z.next_out = reinterpret_cast<Bytef*>(out);
+            z.avail_out = CHUNK_SZ;
+
+            while (z.avail_out > 0) {
+                if (z.avail_in == 0) {
+                    size_t n = std::min(INPUT_SZ, input_left);
+
+                    if (n == 0 || std::fread(input.get(), 1, n, f) != n)
+                        throw va_error("Truncated zip archive member: %s", _name.c_str());
+
+                    input_left -= n;
+                    z.next_in = input.get();
+                    z.avail_in = n;
+                }
+
+                int ret = inflate(&z, Z_NO_FLUSH);
+
+                if (ret == Z_STREAM_END) {
+                    end = true;
+                    break;
+                }
+
+                if (ret != Z_OK)
+                    throw va_error("Corrupt zip archive member (%s): %s", (z.msg) ? z.msg : "inflate failed", _name.c_str());
+            }
+
+            out_sz = CHUNK_SZ - z.avail_out;
+        }
+
+        crc = crc32(crc, reinterpret_cast<const Bytef*>(out), out_sz);
+        size += out_sz;
+        publish(out_sz);
+    }
+
+    if (size != _member.size || crc != _member.crc32)
+        throw va_error("Corrupt zip archive member (size or CRC mismatch): %s", _name.c_str());
+}
+
+
+_PDX_NAMESPACE_END
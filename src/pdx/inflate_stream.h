@@ -0,0 +1,44 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <cstdio>
+
+#include "async_stream.h"
+#include "zip_archive.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* inflate_stream -- one member of a zip archive as a byte_stream, decompressed on a thread of its own so that inflating
+ * the next piece overlaps with the reader lexing the last one. output is handed over in N_CHUNKS chunks of CHUNK_SZ
+ * bytes (see async_stream), so memory use stays at a few MB no matter how large the member. the member's CRC-32 and
+ * size are checked once it has been inflated in full.
+ */
+class inflate_stream final : public async_stream {
+public:
+    static const size_t CHUNK_SZ = 1 << 20;
+    static const uint   N_CHUNKS = 4;
+    static const size_t INPUT_SZ = 1 << 16; // of each read of compressed data
+
+private:
+    const zip_archive& _archive;
+    zip_archive::member _member;
+    std::string _name; // "archive:member"
+
+    void produce() override;
+    void decompress(std::FILE*);
+
+public:
+    inflate_stream() = delete;
+    inflate_stream(const zip_archive&, const zip_archive::member&);
+    ~inflate_stream();
+
+    const char* name() const noexcept override { return _name.c_str(); }
+};
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,322 @@
+#include "json.h"
+#include "error.h"
+
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+const json& json::null_value() noexcept {
+    static const json null;
+    return null;
+}
+
+
+const json& json::operator[](const char* key) const noexcept {
+    for (const auto& m : _o)
+        if (m.first == key)
+            return m.second;
+
+    return null_value();
+}
+
+
+/* PARSING -- recursive descent, with nesting bounded so that hostile input can't exhaust the stack */
+
+class json_parser {
+    static const uint MAX_DEPTH = 256;
+
+    const char* _p;
+    const char* _end;
+    uint _depth;
+
+    [[noreturn]] void fail(const char* what) const { throw va_error("Malformed JSON: %s", what); }
+
+    void skip_ws() {
+        while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r'))
+            ++_p;
+    }
+
+    bool take(char c) {
+        skip_ws();
+
+        if (_p < _end && *_p == c) {
+            ++_p;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool take_word(const char* w) {
+        const size_t n = strlen(w);
+
+        if (size_t(_end - _p) < n || memcmp(_p, w, n) != 0)
+            return false;
+
+        _p += n;
+        return true;
+    }
+
+    static void put_utf8(std::string* p_s, uint32_t cp) {
+        if (cp < 0x80)
+            p_s->push_back(char(cp));
+        else if (cp < 0x800) {
+            p_s->push_back(char(0xC0 | (cp >> 6)));
+            p_s->push_back(char(0x80 | (cp & 0x3F)));
+        }
+        else if (cp < 0x10000) {
+            p_s->push_back(char(0xE0 | (cp >> 12)));
+            p_s->push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+            p_s->push_back(char(0x80 | (cp & 0x3F)));
+        }
+        else {
+            p_s->push_back(char(0xF0 | (cp >> 18)));
+            p_s->push_back(char(0x80 | ((cp >> 12) & 0x3F)));
+            p_s->push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+            p_s->push_back(char(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    uint32_t hex4() {
+        if (_end - _p < 4)
+            fail("truncated \\u escape");
+
+        uint32_t u = 0;
+
+        for (int i = 0; i < 4; ++i, ++_p) {
+            const char c = *_p;
+            u <<= 4;
+
+            if (c >= '0' && c <= '9')      u |= c - '0';
+            else if (c >= 'a' && c <= 'f') u |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') u |= c - 'A' + 10;
+            else fail("bad \\u escape");
+        }
+
+        return u;
+    }
+
+    std::string string() {
+        std::string s;
+
+        while (true) {
+            if (_p >= _end)
+                fail("unterminated string");
+
+            const char c = *_p++;
+
+            if (c == '"')
+                return s;
+
+            if (c != '\\') {
+                s.push_back(c);
+                continue;
+            }
+
+            if (_p >= _end)
+                fail("unterminated string");
+
+            switch (*_p++) {
+            case '"':  s.push_back('"'); break;
+            case '\\': s.push_back('\\'); break;
+            case '/':  s.push_back('/'); break;
+            case 'b':  s.push_back('\b'); break;
+            case 'f':  s.push_back('\f'); break;
+            case 'n':  s.push_back('\n'); break;
+            case 'r':  s.push_back('\r'); break;
+            case 't':  s.push_back('\t'); break;
+            case 'u': {
+                uint32_t cp = hex4();
+
+                /* a surrogate pair */
+                if (cp >= 0xD800 && cp < 0xDC00 && _end - _p >= 6 && _p[0] == '\\' && _p[1] == 'u') {
+                    _p += 2;
+                    const uint32_t lo = hex4();
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                }
+
+                put_utf8(&s, cp);
+                break;
+            }
+            default:
+                fail("bad escape");
+            }
+        }
+    }
+
+public:
+    json_parser(const char* text, size_t size) : _p(text), _end(text + size), _depth(0) {}
+
+    json value() {
+        skip_ws();
+
+        if (_p >= _end)
+            fail("unexpected end of input");
+
+        if (++_depth > MAX_DEPTH)
+            fail("nested too deeply");
+
+        json v;
+        const char c = *_p;
+
+        if (c == '{') {
+            ++_p;
+            v = json::object();
+
+            if (!take('}')) {
+                do {
+                    if (!take('"'))
+                        fail("expected member name");
+
+                    std::string key = string();
+
+                    if (!take(':'))
+                        fail("expected ':'");
+
+                    v.set(key.c_str(), value());
+                } while (take(','));
+
+                if (!take('}'))
+                    fail("expected ',' or '}'");
+            }
+        }
+        else if (c == '[') {
+            ++_p;
+            v = json::array();
+
+            if (!take(']')) {
+                do
+                    v.push_back(value());
+                while (take(','));
+
+                if (!take(']'))
+                    fail("expected ',' or ']'");
+            }
+        }
+        else if (c == '"') {
+            ++_p;
+            v = json(string());
+        }
+        else if (take_word("true"))
+            v = json(true);
+        else if (take_word("false"))
+            v = json(false);
+        else if (take_word("null"))
+            v = json();
+        else {
+            char* num_end;
+            const double n = strtod(_p, &num_end); // always followed by something other than a digit (see parse())
+
+            if (num_end == _p || num_end > _end)
+                fail("unexpected character");
+
+            _p = num_end;
+            v = json(n);
+        }
+
+        --_depth;
+        return v;
+    }
+
+    void finish() {
+        skip_ws();
+
+        if (_p != _end)
+            fail("trailing characters");
+    }
+};
+
+
+json json::parse(const char* text, size_t size) {
+    /* strtod wants a terminated string, and we mustn't let it run off the end of ours */
+    std::string s(text, size);
+    json_parser p(s.c_str(), s.size());
+    json v = p.value();
+    p.finish();
+    return v;
+}
+
+
+/* SERIALIZING */
+
+void json::dump(std::string* p_out) const {
+    std::string& out = *p_out;
+
+    switch (_kind) {
+    case NUL:
+        out += "null";
+        break;
+    case BOOL:
+        out += (_b) ? "true" : "false";
+        break;
+    case NUMBER: {
+        char buf[32];
+
+        if (std::isfinite(_n) && _n == double(int64_t(_n)))
+            snprintf(buf, sizeof(buf), "%lld", (long long)_n);
+        else
+            snprintf(buf, sizeof(buf), "%.17g", (std::isfinite(_n)) ? _n : 0.0);
+
+        out += buf;
+        break;
+    }
+    case STRING:
+        out.push_back('"');
+
+        for (const char c : _s) {
+            switch (c) {
+            case '"':  out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if ((unsigned char)c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                }
+                else
+                    out.push_back(c);
+            }
+        }
+
+        out.push_back('"');
+        break;
+    case ARRAY:
+        out.push_back('[');
+
+        for (size_t i = 0; i < _a.size(); ++i) {
+            if (i > 0)
+                out.push_back(',');
+
+            _a[i].dump(p_out);
+        }
+
+        out.push_back(']');
+        break;
+    case OBJECT:
+        out.push_back('{');
+
+        for (size_t i = 0; i < _o.size(); ++i) {
+            if (i > 0)
+                out.push_back(',');
+
+            out.push_back('"');
+            out += _o[i].first; // member names are always our own, plain ASCII
+            out += "\":";
+            _o[i].second.dump(p_out);
+        }
+
+        out.push_back('}');
+        break;
+    }
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,73 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* json -- just enough of a JSON value to speak JSON-RPC (see lsp_server): parsing, building, and serializing. numbers
+ * are doubles. object members keep their order, and lookups are linear, which is fine for the handful of members a
+ * protocol message has. */
+
+class json {
+public:
+    enum kind_t { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+private:
+    kind_t _kind;
+    bool _b;
+    double _n;
+    std::string _s;
+    std::vector<json> _a;
+    std::vector<std::pair<std::string, json>> _o;
+
+    void dump(std::string* p_out) const;
+
+public:
+    json() : _kind(NUL), _b(false), _n(0) {}
+    json(bool b) : _kind(BOOL), _b(b), _n(0) {}
+    json(int n) : _kind(NUMBER), _b(false), _n(n) {}
+    json(double n) : _kind(NUMBER), _b(false), _n(n) {}
+    json(const char* s) : _kind(STRING), _b(false), _n(0), _s(s) {}
+    json(std::string s) : _kind(STRING), _b(false), _n(0), _s(std::move(s)) {}
+
+    static json array()  { json j; j._kind = ARRAY; return j; }
+    static json object() { json j; j._kind = OBJECT; return j; }
+
+    /* throws if the text isn't a single, well-formed JSON value */
+    static json parse(const char* text, size_t size);
+
+    std::string dump() const { std::string s; dump(&s); return s; }
+
+    kind_t kind() const noexcept { return _kind; }
+    bool is_null() const noexcept   { return _kind == NUL; }
+    bool is_number() const noexcept { return _kind == NUMBER; }
+    bool is_string() const noexcept { return _kind == STRING; }
+    bool is_array() const noexcept  { return _kind == ARRAY; }
+    bool is_object() const noexcept { return _kind == OBJECT; }
+
+    /* (unchecked type) */
+    bool as_bool() const noexcept { return _b; }
+    double as_number() const noexcept { return _n; }
+    const std::string& as_string() const noexcept { return _s; }
+
+    /* a member or element, or null if there's no such thing (so lookups may be chained) */
+    const json& operator[](const char* key) const noexcept;
+    const json& operator[](size_t i) const noexcept { return (i < _a.size()) ? _a[i] : null_value(); }
+    size_t size() const noexcept { return (_kind == OBJECT) ? _o.size() : _a.size(); }
+
+    /* building */
+    json& set(const char* key, json v) { _o.emplace_back(key, std::move(v)); return *this; }
+    json& push_back(json v) { _a.push_back(std::move(v)); return *this; }
+
+    static const json& null_value() noexcept;
+};
+
+
+_PDX_NAMESPACE_END
@@ -1,5 +1,6 @@
 
 #include <cstdio>
+#include <cstring>
 #include "lexer.h"
 #include "scanner.h"
 #include "token.h"
@@ -10,14 +11,74 @@ _PDX_NAMESPACE_BEGIN
 
 
 lexer::lexer(const char* pathname)
-    : _f( std::fopen(pathname, "rb"), std::fclose ),
-      _location(pathname, 0) {
+    : _buf(nullptr),
+      _size(0),
+      _yybuf(nullptr),
+      _pathname(pathname),
+      _location(_pathname.c_str(), size_t(0), &_lines) {
 
-    if (_f.get() == nullptr)
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> f( std::fopen(pathname, "rb"), std::fclose );
+
+    if (f.get() == nullptr)
         throw va_error("Could not open file: %s", pathname);
 
-    yyin = _f.get();
-    yylineno = 1;
+    size_t size;
+
+    if (std::fseek(f.get(), 0, SEEK_END) != 0 || ( size = std::ftell(f.get()) ) == size_t(-1))
+        throw va_error("Could not determine size of file: %s", pathname);
+
+    std::rewind(f.get());
+
+    _owned = std::make_unique<char[]>(size + 2);
+
+    if (std::fread(_owned.get(), 1, size, f.get()) != size)
+        throw va_error("Could not read file: %s", pathname);
+
+    _owned[size] = _owned[size + 1] = '\0'; // YY_END_OF_BUFFER_CHAR
+    scan(_owned.get(), size);
+}
+
+
+lexer::lexer(const memory_span& span)
+    : _buf(nullptr),
+      _size(0),
+      _yybuf(nullptr),
+      _pathname(span.name),
+      _location(_pathname.c_str(), size_t(0), &_lines) {
+
+    scan(span.data, span.size);
+}
+
+
+lexer::lexer(const memory_view& view)
+    : _owned(std::make_unique<char[]>(view.text.size() + 2)),
+      _buf(nullptr),
+      _size(0),
+      _yybuf(nullptr),
+      _pathname(view.name),
+      _location(_pathname.c_str(), size_t(0), &_lines) {
+
+    memcpy(_owned.get(), view.text.data(), view.text.size());
+    _owned[view.text.size()] = _owned[view.text.size() + 1] = '\0'; // YY_END_OF_BUFFER_CHAR
+    scan(_owned.get(), view.text.size());
+}
+
+
+/* point flex at our input buffer (which must already be followed by 2 NUL bytes) */
+void lexer::scan(char* buf, size_t size) {
+    _buf = buf;
+    _size = size;
+    _lines.assign(buf, size);
+
+    if (( _yybuf = yy_scan_buffer(buf, size + 2) ) == nullptr)
+        throw va_error("Input buffer is not followed by 2 NUL bytes: %s", _pathname.c_str());
+
+    yyoffset = 0;
+}
+
+
+lexer::~lexer() {
+    yy_delete_buffer(_yybuf);
 }
 
 
@@ -25,45 +86,41 @@ bool lexer::next(token* p_tok) {
     uint type;
 
     if (( type = yylex() ) == 0) {
-        /* EOF, so close our filehandle, and signal EOF */
-        _f.reset();
-        _location._line = yylineno;
+        /* EOF, so signal EOF */
+        _location._offset = yyoffset;
         p_tok->type = token::END;
         p_tok->text = 0;
-        yyin = nullptr;
-        yylineno = 0;
+        p_tok->len = 0;
         return false;
     }
 
     /* yytext contains token,
        yyleng contains token length,
-       yylineno contains line number,
+       yyoffset contains the offset just past the token,
        type contains token ID */
 
-    _location._line = yylineno;
+    _location._offset = yyoffset - yyleng;
     p_tok->type = type;
 
+    /* flex NUL-terminated yytext in-place; undo that, as our token refers to the text by length */
+    yyrestorehold();
+
     if (type == token::QSTR || type == token::QDATE) {
         assert( yyleng >= 2 );
 
         /* trim quote characters from actual string */
-        yytext[ yyleng-1 ] = '\0';
         p_tok->text = yytext + 1;
-
+        p_tok->len = yyleng - 2;
         return true;
     }
-    else {
-        p_tok->text = yytext;
-    }
 
-    /* if found, strip any trailing '\r' */
+    p_tok->text = yytext;
+    p_tok->len = yyleng;
 
-    if (yyleng > 0) {
-        char* last = &yytext[ yyleng-1 ];
+    /* if found, strip any trailing '\r' */
 
-        if (*last == '\r')
-            *last = '\0';
-    }
+    if (p_tok->len > 0 && p_tok->text[ p_tok->len-1 ] == '\r')
+        --p_tok->len;
 
     return true;
 }
@@ -3,12 +3,16 @@
 #pragma once
 #include "pdx_common.h"
 
-#include <cstdio>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <boost/filesystem.hpp>
 
 #include "file_location.h"
+#include "line_index.h"
+
+
+struct yy_buffer_state;
 
 
 _PDX_NAMESPACE_BEGIN
@@ -18,23 +22,63 @@ namespace fs = boost::filesystem;
 struct token;
 
 
+/* MEMORY_SPAN -- caller-owned script text which is lexed in-place, without any copying. flex needs to write to the
+ * buffer as it goes (though it is left just as it was found) and requires that the text be followed by 2 NUL bytes,
+ * which aren't counted in size. the buffer must outlive the lexer and any tokens taken from it. */
+
+struct memory_span {
+    char*       data;
+    size_t      size;
+    const char* name = "<memory>"; // stands in for a pathname in diagnostics
+};
+
+
+/* MEMORY_VIEW -- read-only script text, which the lexer must therefore copy (once) into a buffer of its own */
+
+struct memory_view {
+    std::string_view text;
+    const char*      name = "<memory>";
+};
+
+
+/* LEXER -- tokenizes a whole buffer of script text, either read into memory from a file up front or provided by the
+ * caller. the input buffer is stable for the lexer's lifetime, so tokens may simply refer to their text in-place (see
+ * pdx::token) */
+
 class lexer {
-    typedef std::unique_ptr<std::FILE, int (*)(std::FILE *)> unique_file_ptr;
-    unique_file_ptr _f;
+    std::unique_ptr<char[]> _owned; // our own copy of the input, unless it's a caller's memory_span
+    char* _buf;                     // the input, followed by the 2 NUL bytes flex expects at the end of its buffer
+    size_t _size;
+    yy_buffer_state* _yybuf;
+
+    std::string _pathname;
+    line_index _lines; // only built if somebody asks for a line number
 
     /* position of last-lexed token */
     file_location _location;
 
+    void scan(char* buf, size_t size);
+
 public:
     lexer() = delete;
+    lexer(const lexer&) = delete;
     lexer(const char* path);
     lexer(const std::string& path) : lexer(path.c_str()) {}
     lexer(const fs::path& path) : lexer(path.string().c_str()) {}
+    lexer(const memory_span&);
+    lexer(const memory_view&);
+    ~lexer();
 
     bool next(token* p_tok);
 
+    /* the raw input (followed by 2 NUL bytes which aren't counted by input_size()) */
+    const char* input() const noexcept { return _buf; }
+    size_t input_size() const noexcept { return _size; }
+
     const char* pathname() const noexcept { return _location.pathname(); }
-    uint line() const noexcept { return _location.line(); }
+    uint line() const { return _location.line(); }
+    uint column() const { return _location.column(); }
+    size_t offset() const noexcept { return _location.offset(); }
     const file_location& location() const noexcept { return _location; }
 };
 
@@ -0,0 +1,66 @@
+
+#include "line_index.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+size_t line_index::count_newlines(const char* buf, size_t sz) noexcept {
+    size_t n = 0;
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i nl = _mm_set1_epi8('\n');
+
+    for (; i + 16 <= sz; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+        n += __builtin_popcount( _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) );
+    }
+#endif
+
+    for (; i < sz; ++i)
+        n += (buf[i] == '\n');
+
+    return n;
+}
+
+
+void line_index::build() const {
+    _newlines.clear();
+    _newlines.reserve( count_newlines(_buf, _sz) );
+
+    const char* p = _buf;
+    const char* end = _buf + _sz;
+
+    while (( p = static_cast<const char*>(memchr(p, '\n', end - p)) ) != nullptr)
+        _newlines.push_back(p++ - _buf);
+
+    _built = true;
+}
+
+
+uint line_index::line(size_t offset) const {
+    if (!_built) build();
+
+    /* 1 + the number of newlines which precede offset */
+    return 1 + std::lower_bound(_newlines.begin(), _newlines.end(), offset) - _newlines.begin();
+}
+
+
+uint line_index::column(size_t offset) const {
+    if (!_built) build();
+
+    auto i = std::lower_bound(_newlines.begin(), _newlines.end(), offset);
+    size_t line_start = (i == _newlines.begin()) ? 0 : *(i - 1) + 1;
+    return 1 + offset - line_start;
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,52 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <vector>
+#include <cstddef>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* line_resolver -- anything which can map the byte offsets recorded by file_location onto line & column numbers */
+class line_resolver {
+public:
+    virtual uint line(size_t offset) const = 0;
+    virtual uint column(size_t offset) const = 0; // 0 if unknown
+
+protected:
+    ~line_resolver() {}
+};
+
+
+/* line_index -- maps byte offsets within a text buffer onto 1-based line and column numbers.
+ *
+ * the lexer only ever tracks byte offsets, because line numbers are only needed when something goes wrong. the first
+ * query builds a sorted table of newline offsets from the lexer's input buffer (the newline count which sizes that
+ * table is vectorized where possible), and every query thereafter is a binary search.
+ */
+class line_index final : public line_resolver {
+    const char* _buf;
+    size_t _sz;
+    mutable std::vector<size_t> _newlines; // offset of every '\n' in the buffer, ascending
+    mutable bool _built;
+
+    void build() const;
+
+public:
+    line_index() : _buf(nullptr), _sz(0), _built(false) {}
+
+    /* (re)target the index at a buffer, which must outlive it; nothing is read until the first query */
+    void assign(const char* buf, size_t sz) noexcept { _buf = buf; _sz = sz; _built = false; }
+
+    /* number of '\n' characters in buf[0, sz) */
+    static size_t count_newlines(const char* buf, size_t sz) noexcept;
+
+    uint line(size_t offset) const override;
+    uint column(size_t offset) const override;
+};
+
+
+_PDX_NAMESPACE_END
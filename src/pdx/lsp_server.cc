@@ -0,0 +1,303 @@
+#include "lsp_server.h"
+#include "error.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* JSON-RPC error codes */
+static const int PARSE_ERROR      = -32700;
+static const int INVALID_REQUEST  = -32600;
+static const int METHOD_NOT_FOUND = -32601;
+static const int INTERNAL_ERROR   = -32603;
+
+static const size_t MAX_MESSAGE_SIZE = 1 << 28; // anything bigger is surely not a message
+
+
+lsp_server::lsp_server(std::FILE* in, std::FILE* out) : _in(in), _out(out), _shutdown(false), _exit(false) {
+#ifdef _WIN32
+    /* Content-Length counts bytes, so no newline translation */
+    _setmode(_fileno(_in), _O_BINARY);
+    _setmode(_fileno(_out), _O_BINARY);
+#endif
+}
+
+
+int lsp_server::run() {
+    std::string body;
+
+    while (!_exit && read_message(&body)) {
+        json msg;
+
+        try {
+            msg = json::parse(body.data(), body.size());
+        }
+        catch (const std::exception& e) {
+            respond_error(json(), PARSE_ERROR, e.what());
+            continue;
+        }
+
+        handle(msg);
+    }
+
+    return (_shutdown) ? 0 : 1;
+}
+
+
+/* FRAMING -- header lines (of which only Content-Length matters), an empty line, and then the body */
+
+bool lsp_server::read_message(std::string* p_body) {
+    size_t length = 0;
+    bool have_length = false;
+
+    while (true) {
+        std::string line;
+        int c;
+
+        while (( c = std::fgetc(_in) ) != EOF && c != '\n')
+            if (c != '\r')
+                line.push_back(char(c));
+
+        if (c == EOF)
+            return false;
+
+        if (line.empty()) {
+            if (have_length)
+                break;
+
+            continue; // stray blank line between messages
+        }
+
+        static const char HEADER[] = "Content-Length:";
+
+        if (strncmp(line.c_str(), HEADER, sizeof(HEADER) - 1) == 0) {
+            length = strtoull(line.c_str() + sizeof(HEADER) - 1, nullptr, 10);
+            have_length = true;
+        }
+    }
+
+    if (length > MAX_MESSAGE_SIZE)
+        throw va_error("Language server message is too big (%zu bytes)", length);
+
+    p_body->resize(length);
+    return std::fread(&(*p_body)[0], 1, length, _in) == length;
+}
+
+
+void lsp_server::write_message(const json& msg) {
+    const std::string body = msg.dump();
+    std::fprintf(_out, "Content-Length: %zu\r\n\r\n", body.size());
+    std::fwrite(body.data(), 1, body.size(), _out);
+    std::fflush(_out);
+}
+
+
+void lsp_server::respond(const json& id, json result) {
+    json msg = json::object();
+    msg.set("jsonrpc", "2.0").set("id", id).set("result", std::move(result));
+    write_message(msg);
+}
+
+
+void lsp_server::respond_error(const json& id, int code, const char* what) {
+    json err = json::object();
+    err.set("code", code).set("message", what);
+
+    json msg = json::object();
+    msg.set("jsonrpc", "2.0").set("id", id).set("error", std::move(err));
+    write_message(msg);
+}
+
+
+/* DISPATCH */
+
+void lsp_server::handle(const json& msg) {
+    const std::string& method = msg["method"].as_string();
+    const json& id = msg["id"];
+    const json& params = msg["params"];
+    const bool is_request = !id.is_null();
+
+    if (method.empty())
+        return; // a response to something we never asked
+
+    if (method == "exit") {
+        _exit = true;
+        return;
+    }
+
+    if (_shutdown) {
+        if (is_request)
+            respond_error(id, INVALID_REQUEST, "Server is shutting down");
+
+        return;
+    }
+
+    try {
+        if (method == "initialize")
+            respond(id, initialize());
+        else if (method == "shutdown") {
+            _shutdown = true;
+            respond(id, json());
+        }
+        else if (method == "textDocument/didOpen") {
+            const json& doc = params["textDocument"];
+            const std::string& uri = doc["uri"].as_string();
+            _docs[uri] = std::make_unique<script_document>(uri, doc["text"].as_string());
+            publish_diagnostics(uri);
+        }
+        else if (method == "textDocument/didChange")
+            did_change(params);
+        else if (method == "textDocument/didClose") {
+            const std::string& uri = params["textDocument"]["uri"].as_string();
+            _docs.erase(uri);
+            publish_diagnostics(uri); // (i.e., clear them)
+        }
+        else if (method == "textDocument/definition")
+            respond(id, definition(params));
+        else if (is_request)
+            respond_error(id, METHOD_NOT_FOUND, ("Unsupported method: " + method).c_str());
+
+        /* notifications we don't know (e.g., "initialized", "$/cancelRequest") are simply ignored */
+    }
+    catch (const std::exception& e) {
+        if (is_request)
+            respond_error(id, INTERNAL_ERROR, e.what());
+    }
+}
+
+
+json lsp_server::initialize() {
+    json sync = json::object();
+    sync.set("openClose", true).set("change", 2); // incremental
+
+    json capabilities = json::object();
+    capabilities.set("textDocumentSync", std::move(sync)).set("definitionProvider", true);
+
+    json info = json::object();
+    info.set("name", "pdx");
+
+    json result = json::object();
+    result.set("capabilities", std::move(capabilities)).set("serverInfo", std::move(info));
+    return result;
+}
+
+
+void lsp_server::did_change(const json& params) {
+    const std::string& uri = params["textDocument"]["uri"].as_string();
+    auto it = _docs.find(uri);
+
+    if (it == _docs.end())
+        return;
+
+    script_document& doc = *it->second;
+    const json& changes = params["contentChanges"];
+
+    for (size_t i = 0; i < changes.size(); ++i) {
+        const json& change = changes[i];
+        const json& r = change["range"];
+
+        if (r.is_null()) {
+            doc.assign(change["text"].as_string());
+            continue;
+        }
+
+        const json& start = r["start"];
+        const json& end = r["end"];
+        doc.edit(doc.offset(uint(start["line"].as_number()), uint(start["character"].as_number())),
+                 doc.offset(uint(end["line"].as_number()), uint(end["character"].as_number())),
+                 change["text"].as_string());
+    }
+
+    publish_diagnostics(uri);
+}
+
+
+json lsp_server::definition(const json& params) {
+    json locations = json::array();
+    auto it = _docs.find(params["textDocument"]["uri"].as_string());
+
+    if (it == _docs.end())
+        return locations;
+
+    const script_document& doc = *it->second;
+    const json& pos = params["position"];
+    const auto word = doc.word_at(doc.offset(uint(pos["line"].as_number()), uint(pos["character"].as_number())));
+
+    if (word.second == 0)
+        return locations;
+
+    const std::string name(doc.text() + word.first, word.second);
+
+    for (const auto& d : _docs) {
+        for (const auto& def : d.second->definitions(name)) {
+            json loc = json::object();
+            loc.set("uri", d.first).set("range", range(*def.p_doc, def.offset, def.offset + def.length));
+            locations.push_back(std::move(loc));
+        }
+    }
+
+    return locations;
+}
+
+
+void lsp_server::publish_diagnostics(const std::string& uri) {
+    json diags = json::array();
+    auto it = _docs.find(uri);
+
+    if (it != _docs.end()) {
+        const script_document& doc = *it->second;
+
+        for (const auto& d : doc.diagnostics()) {
+            size_t end;
+
+            if (d.whole_line)
+                end = doc.offset(doc.position(d.offset).first, UINT_MAX);
+            else {
+                const auto word = doc.word_at(d.offset);
+                end = (word.first == d.offset && word.second > 0) ? d.offset + word.second : d.offset + 1;
+            }
+
+            json diag = json::object();
+            diag.set("range", range(doc, d.offset, end))
+                .set("severity", (d.warning) ? 2 : 1)
+                .set("source", "pdx")
+                .set("message", d.msg);
+
+            diags.push_back(std::move(diag));
+        }
+    }
+
+    json params = json::object();
+    params.set("uri", uri).set("diagnostics", std::move(diags));
+
+    json msg = json::object();
+    msg.set("jsonrpc", "2.0").set("method", "textDocument/publishDiagnostics").set("params", std::move(params));
+    write_message(msg);
+}
+
+
+json lsp_server::position(const script_document& doc, size_t offset) {
+    const auto pos = doc.position(offset);
+    json p = json::object();
+    p.set("line", int(pos.first)).set("character", int(pos.second));
+    return p;
+}
+
+
+json lsp_server::range(const script_document& doc, size_t begin, size_t end) {
+    json r = json::object();
+    r.set("start", position(doc, begin)).set("end", position(doc, end));
+    return r;
+}
+
+
+_PDX_NAMESPACE_END
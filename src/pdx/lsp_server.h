@@ -0,0 +1,61 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <memory>
+#include <map>
+#include <cstdio>
+
+#include "json.h"
+#include "script_document.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* LSP_SERVER -- a Language Server Protocol frontend, speaking JSON-RPC over a pair of streams (normally stdin &
+ * stdout) with Content-Length framing.
+ *
+ * every open document is kept resident as a script_document, so an edit costs only re-lexing the damaged range and
+ * reparsing the top-level statements it touched, after which the document's diagnostics are published. go-to-
+ * definition is answered from the definitions indexed by each open document (top-level keys, titles, & event IDs).
+ *
+ * supported: initialize, initialized, shutdown, exit, textDocument/didOpen, didChange (incremental or full), didClose,
+ * & definition. positions are taken to count bytes, which is exact for the ASCII which makes up nearly all script.
+ * requests are served one at a time, in order (the lexer being what it is).
+ */
+
+class lsp_server {
+    std::FILE* _in;
+    std::FILE* _out;
+    bool _shutdown;
+    bool _exit;
+    std::map<std::string, std::unique_ptr<script_document>> _docs; // by URI
+
+    bool read_message(std::string* p_body);
+    void write_message(const json&);
+
+    void handle(const json& msg);
+    void respond(const json& id, json result);
+    void respond_error(const json& id, int code, const char* msg);
+    void publish_diagnostics(const std::string& uri);
+
+    json initialize();
+    json definition(const json& params);
+    void did_change(const json& params);
+
+    static json position(const script_document&, size_t offset);
+    static json range(const script_document&, size_t begin, size_t end);
+
+public:
+    lsp_server(std::FILE* in = stdin, std::FILE* out = stdout);
+    lsp_server(const lsp_server&) = delete;
+
+    /* serve until told to exit (or the input ends). returns the process exit code the protocol calls for. */
+    int run();
+};
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,335 @@
+#include "mod_batch.h"
+#include "batch_loader.h"
+#include "hash.h"
+#include "error.h"
+
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PDX_HAVE_FORK 1
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <poll.h>
+#endif
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* a script file in a mod layer: a real file, or a member of a zip archive layer */
+struct script_file {
+    fs::path real_path;
+    const zip_archive* p_archive;
+    const zip_archive::member* p_member;
+};
+
+typedef std::vector<std::pair<std::string, script_file>> file_list; // by virtual path
+
+typedef std::vector<std::unique_ptr<zip_archive>> archive_list; // whatever file_lists' members are from
+
+
+static bool is_script(const fs::path& p) {
+    std::string ext = p.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".txt";
+}
+
+
+/* every .txt file beneath root, which may instead be a zip archive (whose central directory is added to *p_archives)
+   for a mod layer as the Steam Workshop ships it */
+static void find_script_files(file_list* p_files, const fs::path& root, archive_list* p_archives) {
+    if (p_archives && fs::is_regular_file(root) && zip_archive::is_zip(root)) {
+        p_archives->push_back( std::make_unique<zip_archive>(root) );
+        const zip_archive* p_archive = p_archives->back().get();
+
+        for (const auto& m : p_archive->members())
+            if (is_script(m.name))
+                p_files->push_back({ m.name, { root / m.name, p_archive, &m } });
+
+        return;
+    }
+
+    if (!fs::is_directory(root))
+        throw va_error("Not a folder: %s", root.string().c_str());
+
+    for (fs::recursive_directory_iterator it(root), end; it != end; ++it) {
+        if (fs::is_regular_file(it->status()) && is_script(it->path())) {
+            const std::string virtual_path = it->path().lexically_relative(root).generic_string();
+            p_files->push_back({ virtual_path, { it->path(), nullptr, nullptr } });
+        }
+    }
+}
+
+
+/* files are read (or inflated, for archive members) in parallel but (the lexer being what it is) parsed one at a time,
+   as each is read. those whose content is already in *p_trees are given the same tree instead, and those parsed are
+   added to it. their strings go to *p_strings, if given. returns the number of files parsed. */
+static size_t parse_files(mod_batch::tree_map* p_map, const file_list& files, tree_share* p_trees,
+                          string_store* p_strings) {
+    std::vector<fs::path> paths;
+    std::map<const zip_archive*, std::vector<const zip_archive::member*>> members; // by archive
+    std::unordered_map<std::string, const std::string*> virtual_paths; // by loaded_file pathname
+
+    paths.reserve(files.size());
+
+    for (const auto& f : files) {
+        const script_file& sf = f.second;
+
+        if (sf.p_member) {
+            members[sf.p_archive].push_back(sf.p_member);
+            virtual_paths[sf.p_archive->pathname() + ":" + sf.p_member->name] = &f.first;
+        }
+        else {
+            paths.push_back(sf.real_path);
+            virtual_paths[sf.real_path.string()] = &f.first;
+        }
+    }
+
+    batch_loader loader;
+    size_t n_parsed = 0;
+
+    std::unique_ptr<string_store::writer> up_writer;
+    parse_options opts;
+
+    if (p_strings) {
+        up_writer = std::make_unique<string_store::writer>(*p_strings);
+        opts.p_strings = &up_writer->pool();
+    }
+
+    const batch_loader::callback on_load = [&](loaded_file& f) {
+        mod_batch::file_result& r = (*p_map)[*virtual_paths.at(f.pathname)];
+
+        if (f.error) {
+            r.fatal = strerror(f.error);
+            return;
+        }
+
+        const uint64_t hash = hash64(f.data.get(), f.size);
+
+        if (p_trees->find(&r.tree, hash))
+            return;
+
+        ++n_parsed;
+
+        try {
+            r.tree = parsed_file::parse(std::move(f), opts);
+            p_trees->add(hash, r.tree);
+        }
+        catch (const std::exception& e) {
+            r.fatal = e.what();
+        }
+    };
+
+    loader.load(paths, on_load);
+
+    for (const auto& m : members)
+        loader.load(*m.first, m.second, on_load);
+
+    return n_parsed;
+}
+
+
+mod_batch::mod_batch(const fs::path& game_path) : _game_path(game_path) {
+    file_list files;
+    find_script_files(&files, _game_path, nullptr);
+    _n_base_parsed = parse_files(&_base, files, &_base_trees, &_base_strings);
+    _base_strings.consolidate();
+}
+
+
+const mod_batch::file_result* mod_batch::overlay::get(const std::string& virtual_path) const {
+    auto it = _delta.find(virtual_path);
+
+    if (it != _delta.end())
+        return &it->second;
+
+    it = _base.find(virtual_path);
+    return (it != _base.end()) ? &it->second : nullptr;
+}
+
+
+mod_batch::overlay mod_batch::load(const std::vector<fs::path>& mod_stack) const {
+    /* where a submod and its mod provide the same file, the submod's wins */
+    std::map<std::string, script_file> top;
+    archive_list archives;
+
+    for (const auto& layer : mod_stack) {
+        file_list files;
+        find_script_files(&files, layer, &archives);
+
+        for (auto& f : files)
+            top[f.first] = std::move(f.second);
+    }
+
+    overlay ov(_base);
+    tree_share delta_trees(&_base_trees);
+    ov._n_parsed = parse_files(&ov._delta, file_list(top.cbegin(), top.cend()), &delta_trees, nullptr);
+    ov._n_duplicates = delta_trees.n_hits();
+    return ov;
+}
+
+
+std::string mod_batch::audit_one(const std::vector<fs::path>& mod_stack) const {
+    const auto t0 = std::chrono::steady_clock::now();
+    std::string out = "mod ";
+    size_t n_files = 0;
+    size_t n_parsed = 0;
+    size_t n_duplicates = 0;
+
+    for (size_t i = 0; i < mod_stack.size(); ++i)
+        out += ((i > 0) ? "," : "") + mod_stack[i].string();
+
+    out += "\n";
+
+    try {
+        const overlay ov = load(mod_stack);
+        n_parsed = ov.n_parsed();
+        n_duplicates = ov.n_duplicates();
+
+        ov.for_each([&](const std::string& virtual_path, const file_result& r) {
+            ++n_files;
+
+            if (!r.fatal.empty()) {
+                out += "fatal " + virtual_path + ": " + r.fatal + "\n";
+                return;
+            }
+
+            for (auto&& e : r.tree.errors())
+                out += "error " + virtual_path + ":L" + std::to_string(e._location.line()) + ": " + e.what() + "\n";
+        });
+    }
+    catch (const std::exception& e) {
+        out += "fatal " + mod_stack.back().string() + ": " + e.what() + "\n";
+    }
+
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0);
+
+    out += "done " + std::to_string(n_files) + " files, " + std::to_string(n_parsed) + " parsed, "
+         + std::to_string(n_duplicates) + " duplicates, " + std::to_string(ms.count()) + " ms\n";
+
+    return out;
+}
+
+
+#ifdef PDX_HAVE_FORK
+
+std::vector<std::string> mod_batch::audit(const std::vector<std::vector<fs::path>>& mod_stacks, uint max_jobs) const {
+    struct job {
+        size_t i;
+        pid_t pid;
+        int fd; // the read end of the pipe from the worker, which writes its report & exits
+    };
+
+    std::vector<std::string> reports(mod_stacks.size());
+    std::vector<job> running;
+    size_t next = 0;
+
+    max_jobs = std::max(max_jobs, 1u);
+
+    while (next < mod_stacks.size() || !running.empty()) {
+        while (running.size() < max_jobs && next < mod_stacks.size()) {
+            int fds[2];
+
+            if (::pipe(fds) != 0)
+                throw va_error("Could not create pipe: %s", strerror(errno));
+
+            const pid_t pid = ::fork();
+
+            if (pid < 0) {
+                const int err = errno;
+                ::close(fds[0]);
+                ::close(fds[1]);
+                throw va_error("Could not start audit worker: %s", strerror(err));
+            }
+
+            if (pid == 0) {
+                /* the worker: no destructors on the way out, which would only spend time freeing (and so touching,
+                   and so copying) the base's trees */
+                ::close(fds[0]);
+
+                const std::string report = audit_one(mod_stacks[next]);
+
+                for (size_t sent = 0; sent < report.size(); ) {
+                    const ssize_t n = ::write(fds[1], report.data() + sent, report.size() - sent);
+
+                    if (n < 0 && errno == EINTR)
+                        continue;
+
+                    if (n <= 0)
+                        ::_exit(1);
+
+                    sent += n;
+                }
+
+                ::_exit(0);
+            }
+
+            ::close(fds[1]);
+            running.push_back({ next++, pid, fds[0] });
+        }
+
+        std::vector<pollfd> pfds;
+
+        for (const auto& j : running)
+            pfds.push_back({ j.fd, POLLIN, 0 });
+
+        if (::poll(pfds.data(), pfds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            throw va_error("Could not wait for audit workers: %s", strerror(errno));
+        }
+
+        for (size_t k = pfds.size(); k-- > 0; ) {
+            if (pfds[k].revents == 0)
+                continue;
+
+            job& j = running[k];
+            char buf[65536];
+            const ssize_t n = ::read(j.fd, buf, sizeof(buf));
+
+            if (n > 0) {
+                reports[j.i].append(buf, n);
+                continue;
+            }
+
+            if (n < 0 && errno == EINTR)
+                continue;
+
+            /* EOF: the worker is done (one way or another) */
+            int status = 0;
+            ::close(j.fd);
+            ::waitpid(j.pid, &status, 0);
+
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                reports[j.i] += "fatal " + mod_stacks[j.i].back().string() + ": audit worker exited abnormally\n";
+
+            running.erase(running.begin() + k);
+        }
+    }
+
+    return reports;
+}
+
+#else
+
+std::vector<std::string> mod_batch::audit(const std::vector<std::vector<fs::path>>& mod_stacks, uint max_jobs) const {
+    std::vector<std::string> reports;
+
+    for (const auto& stack : mod_stacks)
+        reports.push_back(audit_one(stack));
+
+    return reports;
+}
+
+#endif
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,119 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+#include "parse_cache.h"
+#include "string_store.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* MOD_BATCH -- audits many mods against the same game install in one run. the base game is parsed once, up front;
+ * each mod stack (a mod and any submods, lowest-priority first) is then an overlay of just its own files' trees on
+ * the shared base, so auditing it costs only parsing those. a mod (but not the base game) may be a zip archive, as
+ * the Steam Workshop ships them, whose files are inflated straight into memory.
+ *
+ * where fork() is available, mod stacks are audited concurrently in child processes (the lexer being what it is,
+ * threads wouldn't help), each of which shares the parsed base with its parent copy-on-write. elsewhere, they're
+ * audited one after another in-process.
+ *
+ * files are also deduplicated by content hash (see tree_share): a file with the same content as one already parsed,
+ * either elsewhere in the base or (for a mod's file) in the base or elsewhere in its mod stack, shares that file's tree
+ * rather than being parsed again.
+ *
+ * like the daemon, auditing currently amounts to reporting every file's parse errors, in the same format:
+ *
+ *   mod <layer>[,<layer>...]
+ *   error <path>:L<line>: <message>
+ *   fatal <path>: <message>
+ *   done <n> files, <n> parsed, <n> duplicates, <n> ms   (of the mod's own files, those parsed & those shared)
+ */
+
+class mod_batch {
+public:
+    struct file_result {
+        parsed_file tree;
+        std::string fatal; // why it couldn't be parsed (in which case there's no tree)
+    };
+
+    typedef std::map<std::string, file_result> tree_map; // by virtual path (generic form)
+
+    /* the files of one mod stack: its own (the delta) over those of the base which it doesn't override */
+    class overlay {
+        const tree_map& _base;
+        tree_map _delta;
+        size_t _n_parsed;
+        size_t _n_duplicates;
+
+        friend class mod_batch;
+        overlay(const tree_map& base) : _base(base), _n_parsed(0), _n_duplicates(0) {}
+
+    public:
+        const file_result* get(const std::string& virtual_path) const;
+        const tree_map& delta() const noexcept { return _delta; }
+        size_t n_parsed() const noexcept     { return _n_parsed; }     // of the delta
+        size_t n_duplicates() const noexcept { return _n_duplicates; } // of the delta, given another file's tree
+
+        /* f(virtual_path, file_result) for every file, in order of virtual path */
+        template<class F> void for_each(F&& f) const;
+    };
+
+private:
+    fs::path _game_path;
+    string_store _base_strings; // those of the base's trees, which share chunks rather than each having its own
+    tree_map _base;
+    tree_share _base_trees;
+    size_t _n_base_parsed;
+
+    std::string audit_one(const std::vector<fs::path>& mod_stack) const;
+
+public:
+    /* parse every .txt file beneath game_path */
+    mod_batch(const fs::path& game_path);
+    mod_batch(const mod_batch&) = delete;
+
+    size_t n_base_files() const noexcept { return _base.size(); }
+    size_t n_base_parsed() const noexcept { return _n_base_parsed; }
+    size_t n_base_duplicates() const noexcept { return _base_trees.n_hits(); } // given another file's tree
+
+    /* parse just the files which the mod stack provides */
+    overlay load(const std::vector<fs::path>& mod_stack) const;
+
+    /* a report for each mod stack (in the order given), auditing up to max_jobs of them at once */
+    std::vector<std::string> audit(const std::vector<std::vector<fs::path>>& mod_stacks, uint max_jobs) const;
+};
+
+
+template<class F>
+void mod_batch::overlay::for_each(F&& f) const {
+    auto b = _base.cbegin();
+    auto d = _delta.cbegin();
+
+    while (b != _base.cend() || d != _delta.cend()) {
+        if (d == _delta.cend() || (b != _base.cend() && b->first < d->first)) {
+            f(b->first, b->second);
+            ++b;
+            continue;
+        }
+
+        if (b != _base.cend() && b->first == d->first)
+            ++b; // overridden
+
+        f(d->first, d->second);
+        ++d;
+    }
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,174 @@
+#include "parse_cache.h"
+#include "tree_image.h"
+#include "binary_file.h"
+#include "error.h"
+
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* ENTRY FORMAT -- a header, followed by a single tree image: its nodes, then its string table */
+
+static const char ENTRY_MAGIC[8] = { 'p', 'd', 'x', 't', 'r', 'e', 'e', '\0' };
+
+struct entry_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t is_save;
+    uint64_t content_hash;
+    uint64_t n_nodes;
+    uint64_t strings_size;
+};
+
+static_assert(sizeof(entry_header) == 40, "unexpected padding in parse cache entry header");
+
+
+/* a tree loaded from the cache, which must be destroyed before the mapping its strings point into */
+struct cached_tree {
+    boost::iostreams::mapped_file map;
+    std::unique_ptr<block> up_root;
+};
+
+
+/* TREE_SHARE */
+
+bool tree_share::find_locked(parsed_file* p_file, uint64_t content_hash) const {
+    auto it = _trees.find(content_hash);
+
+    if (it == _trees.end())
+        return false;
+
+    std::shared_ptr<void> owner = it->second.owner.lock();
+
+    if (!owner)
+        return false; // (gone; its entry goes at the next sweep)
+
+    p_file->_owner = std::move(owner);
+    p_file->_p_root = it->second.p_root;
+    p_file->_p_errors = it->second.p_errors;
+    p_file->_from_cache = it->second.from_cache;
+    return true;
+}
+
+
+bool tree_share::find(parsed_file* p_file, uint64_t content_hash) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++_n_lookups;
+
+    bool found = find_locked(p_file, content_hash);
+
+    if (!found && _p_fallback) {
+        std::lock_guard<std::mutex> fallback_lock(_p_fallback->_mutex);
+        found = _p_fallback->find_locked(p_file, content_hash);
+    }
+
+    _n_hits += found;
+    return found;
+}
+
+
+void tree_share::add(uint64_t content_hash, const parsed_file& f) {
+    if (!f._owner)
+        return;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _trees[content_hash] = { f._owner, f._p_root, f._p_errors, f._from_cache };
+
+    if (_trees.size() < _sweep_at)
+        return;
+
+    for (auto it = _trees.begin(); it != _trees.end(); )
+        it = (it->second.owner.expired()) ? _trees.erase(it) : std::next(it);
+
+    _sweep_at = std::max<size_t>(64, 2 * _trees.size());
+}
+
+
+/* PARSE_CACHE */
+
+parse_cache::parse_cache(const fs::path& dir, fingerprint_cache& fingerprints)
+    : _dir(dir), _fingerprints(fingerprints), _n_hits(0), _n_misses(0) {
+
+    fs::create_directories(_dir);
+}
+
+
+fs::path parse_cache::entry_path(uint64_t content_hash, bool is_save) const {
+    char name[32];
+    snprintf(&name[0], sizeof(name), "%016llx.%s", (unsigned long long)content_hash, (is_save) ? "sav" : "txt");
+    return _dir / name;
+}
+
+
+bool parse_cache::load(parsed_file* p_file, const fs::path& entry, uint64_t content_hash, bool is_save) const {
+    boost::system::error_code ec;
+    const uint64_t size = fs::file_size(entry, ec);
+
+    if (ec || size < sizeof(entry_header))
+        return false;
+
+    auto sp_tree = std::make_shared<cached_tree>();
+
+    try {
+        sp_tree->map.open(entry.string(), boost::iostreams::mapped_file::priv);
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+
+    entry_header hdr;
+    std::copy_n(sp_tree->map.data(), sizeof(hdr), reinterpret_cast<char*>(&hdr));
+
+    if (!std::equal(hdr.magic, hdr.magic + sizeof(hdr.magic), ENTRY_MAGIC)
+        || hdr.version != VERSION
+        || hdr.is_save != uint32_t(is_save)
+        || hdr.content_hash != content_hash
+        || hdr.n_nodes > (size - sizeof(hdr)) / sizeof(tree_node)
+        || hdr.strings_size != size - sizeof(hdr) - hdr.n_nodes * sizeof(tree_node))
+        return false;
+
+    char* p_nodes = sp_tree->map.data() + sizeof(hdr);
+    tree_image_reader reader(reinterpret_cast<const tree_node*>(p_nodes), hdr.n_nodes,
+                             p_nodes + hdr.n_nodes * sizeof(tree_node), hdr.strings_size);
+    sp_tree->up_root = reader.read();
+
+    if (!sp_tree->up_root)
+        return false;
+
+    static const error_queue no_errors;
+
+    p_file->_p_root = sp_tree->up_root.get();
+    p_file->_p_errors = &no_errors;
+    p_file->_from_cache = true;
+    p_file->_owner = std::move(sp_tree);
+    return true;
+}
+
+
+void parse_cache::store(const fs::path& entry, const block& root, uint64_t content_hash, bool is_save) const {
+    tree_image_writer writer;
+    writer.add(root);
+
+    entry_header hdr;
+    std::copy_n(ENTRY_MAGIC, sizeof(hdr.magic), hdr.magic);
+    hdr.version = VERSION;
+    hdr.is_save = is_save;
+    hdr.content_hash = content_hash;
+    hdr.n_nodes = writer.nodes().size();
+    hdr.strings_size = writer.strings().size();
+
+    /* (written alongside & renamed into place, so that no reader ever maps a partial entry) */
+    write_file_atomically(entry, [&](std::FILE* f) {
+        return std::fwrite(&hdr, sizeof(hdr), 1, f) == 1
+            && std::fwrite(writer.nodes().data(), sizeof(tree_node), hdr.n_nodes, f) == hdr.n_nodes
+            && std::fwrite(writer.strings().data(), 1, hdr.strings_size, f) == hdr.strings_size;
+    });
+}
+
+
+_PDX_NAMESPACE_END
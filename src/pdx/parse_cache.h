@@ -0,0 +1,203 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+#include "parser.h"
+#include "fingerprint.h"
+#include "batch_loader.h"
+#include "token_list.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* PARSED_FILE -- a parse tree handed out by parse_cache, along with whatever owns its storage: the parser, if the file
+ * had to be parsed, or else the mapped cache file. cheap to copy; the tree lives as long as any copy does. */
+
+class parsed_file {
+    std::shared_ptr<void> _owner;
+    block* _p_root;
+    const error_queue* _p_errors;
+    bool _from_cache;
+
+    friend class parse_cache;
+    friend class snapshot;
+    friend class tree_share;
+
+public:
+    parsed_file() : _p_root(nullptr), _p_errors(nullptr), _from_cache(false) {}
+
+    /* parse a file afresh, without involving any cache */
+    template<class Policy = script_policy>
+    static parsed_file parse(const fs::path& real_path);
+
+    /* ...or one which has already been read into memory (see batch_loader), taking over its buffer */
+    template<class Policy = script_policy>
+    static parsed_file parse(loaded_file&&, const parse_options& = parse_options());
+
+    /* ...or one which has already been lexed (see token_list), which may happen on any thread */
+    template<class Policy = script_policy>
+    static parsed_file parse(lexed_text&&);
+
+    block* root_block() const noexcept { return _p_root; }
+    const error_queue& errors() const noexcept { return *_p_errors; } // always empty for a tree from the cache
+    bool from_cache() const noexcept { return _from_cache; }
+};
+
+
+template<class Policy>
+parsed_file parsed_file::parse(const fs::path& real_path) {
+    auto sp_parser = std::make_shared< basic_parser<lexer, Policy> >(real_path);
+    parsed_file f;
+    f._p_root = sp_parser->root_block();
+    f._p_errors = &sp_parser->errors();
+    f._owner = std::move(sp_parser);
+    return f;
+}
+
+
+template<class Policy>
+parsed_file parsed_file::parse(loaded_file&& loaded, const parse_options& opts) {
+    struct owner {
+        std::unique_ptr<char[]> data; // (lexed in place, so it must outlive the parser)
+        basic_parser<lexer, Policy> parser;
+
+        owner(loaded_file& lf, const parse_options& opts)
+            : data(std::move(lf.data)), parser(memory_span{ data.get(), lf.size, lf.pathname.c_str() }, opts) {}
+    };
+
+    auto sp_owner = std::make_shared<owner>(loaded, opts);
+    parsed_file f;
+    f._p_root = sp_owner->parser.root_block();
+    f._p_errors = &sp_owner->parser.errors();
+    f._owner = std::move(sp_owner);
+    return f;
+}
+
+
+template<class Policy>
+parsed_file parsed_file::parse(lexed_text&& text) {
+    auto sp_parser = std::make_shared< basic_parser<token_list, Policy> >(std::move(text));
+    parsed_file f;
+    f._p_root = sp_parser->root_block();
+    f._p_errors = &sp_parser->errors();
+    f._owner = std::move(sp_parser);
+    return f;
+}
+
+
+/* TREE_SHARE -- the parse trees of files in memory, by content hash (hash64 of the file's bytes, as in a fingerprint),
+ * so that a file with the same content as one already parsed can share that one's tree (read-only) rather than being
+ * parsed again. mods often ship verbatim copies of base game files, and submods of their mod's.
+ *
+ * trees are held weakly: one is shared only for as long as something else keeps it alive, and is forgotten after.
+ * only trees which parsed without a fatal error are ever added, and their non-fatal errors are shared along with them
+ * (so those errors' locations name whichever file was parsed, and should be reported by line). every tree must have
+ * been parsed under the same policy, or else the policy must follow from the content (as for a text savegame).
+ *
+ * a share may fall back on another, e.g. a mod's on the base game's, which is then only read. safe from any thread.
+ */
+
+class tree_share {
+    struct entry {
+        std::weak_ptr<void> owner;
+        block* p_root;
+        const error_queue* p_errors;
+        bool from_cache;
+    };
+
+    const tree_share* _p_fallback;
+    mutable std::mutex _mutex;
+    std::unordered_map<uint64_t, entry> _trees;
+    size_t _sweep_at; // when to next drop the entries of trees which are gone
+    uint64_t _n_lookups;
+    uint64_t _n_hits;
+
+    bool find_locked(parsed_file*, uint64_t content_hash) const;
+
+public:
+    tree_share(const tree_share* p_fallback = nullptr)
+        : _p_fallback(p_fallback), _sweep_at(64), _n_lookups(0), _n_hits(0) {}
+    tree_share(const tree_share&) = delete;
+
+    /* the tree of a file with that content, if there is one (here or in the fallback) */
+    bool find(parsed_file*, uint64_t content_hash);
+
+    /* offer a file's tree to those to come */
+    void add(uint64_t content_hash, const parsed_file&);
+
+    uint64_t n_lookups() const noexcept { return _n_lookups; }
+    uint64_t n_hits() const noexcept    { return _n_hits; }   // files which shared a tree rather than being parsed
+};
+
+
+/* PARSE_CACHE -- parse trees persisted in a directory, keyed by the content hash of the file they were parsed from,
+ * so that a file which hasn't changed since any earlier run needn't be lexed or parsed again.
+ *
+ * each entry is a flat image of the tree: a header, the tree's objects in pre-order as fixed-size nodes (numbers and
+ * dates already converted), and a table of the distinct strings. a hit maps the entry copy-on-write & rebuilds the
+ * block tree straight from the nodes, with its strings pointing into the mapping. (so strings which were equal in the
+ * source may now share storage.) entries written by any other VERSION, or found to be malformed, count as misses and
+ * are overwritten.
+ *
+ * only files which parse without any errors are cached, so that those errors are reported again on every run.
+ */
+
+class parse_cache {
+    fs::path _dir;
+    fingerprint_cache& _fingerprints;
+    uint64_t _n_hits;
+    uint64_t _n_misses;
+
+    fs::path entry_path(uint64_t content_hash, bool is_save) const;
+    bool load(parsed_file*, const fs::path& entry, uint64_t content_hash, bool is_save) const;
+    void store(const fs::path& entry, const block& root, uint64_t content_hash, bool is_save) const;
+
+public:
+    /* bump whenever the entry format or the parser's output for any given input changes */
+    static const uint32_t VERSION = 2;
+
+    /* creates the directory if need be. fingerprints are taken from (and kept in) the given fingerprint_cache. */
+    parse_cache(const fs::path& dir, fingerprint_cache&);
+
+    template<class Policy = script_policy>
+    parsed_file get(const fs::path& real_path);
+
+    uint64_t n_hits() const noexcept   { return _n_hits; }
+    uint64_t n_misses() const noexcept { return _n_misses; }
+};
+
+
+template<class Policy>
+parsed_file parse_cache::get(const fs::path& real_path) {
+    const uint64_t content_hash = _fingerprints.get(real_path).hash;
+    const fs::path entry = entry_path(content_hash, Policy::is_save);
+    parsed_file f;
+
+    if (load(&f, entry, content_hash, Policy::is_save)) {
+        ++_n_hits;
+        return f;
+    }
+
+    ++_n_misses;
+    f = parsed_file::parse<Policy>(real_path);
+
+    /* don't file the tree under a hash which no longer describes the file (i.e., it changed while we parsed it) */
+    if (f.errors().empty() && _fingerprints.stamp(real_path).has_hash)
+        store(entry, *f.root_block(), content_hash, Policy::is_save);
+
+    return f;
+}
+
+
+_PDX_NAMESPACE_END
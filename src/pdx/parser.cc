@@ -10,104 +10,6 @@
 _PDX_NAMESPACE_BEGIN
 
 
-block::block(parser& lex, bool is_root, bool is_save) {
-
-    if (is_root && is_save) {
-        /* skip over CK2txt header (savegames only) */
-        token t;
-        lex.next_expected(&t, token::STR);
-    }
-
-    while (1) {
-        token tok;
-
-        lex.next(&tok, is_root);
-
-        if (tok.type == token::END)
-            return;
-
-        if (tok.type == token::CLOSE) {
-            if (is_root && !is_save) // closing braces are only bad at root level
-                throw va_error("Unmatched closing brace in %s (before line %u)",
-                               lex.pathname(), lex.line());
-
-            // otherwise, they mean it's time return to the previous block
-            return;
-        }
-
-        object key;
-
-        if (tok.type == token::STR)
-            key = object{ lex.strdup(tok.text) };
-        else if (tok.type == token::DATE)
-            key = object{ date{ tok.text, lex.location(), lex.errors() } };
-        else if (tok.type == token::INTEGER)
-            key = object{ atoi(tok.text) };
-        else
-            lex.unexpected_token(tok);
-
-        /* ...done with key */
-
-        lex.next_expected(&tok, token::EQ);
-
-        /* on to value... */
-        object val;
-        lex.next(&tok);
-
-        if (tok.type == token::OPEN) {
-
-            /* need to do token lookahead for 2 tokens to determine whether this is opening a
-               generic list or a recursive block of statements */
-
-            lex.next(&tok);
-            bool double_open = false;
-
-            if (tok.type == token::CLOSE) {
-                /* empty block */
-                val = object{ std::make_unique<block>() };
-                _vec.emplace_back(key, val);
-                continue;
-            }
-            else if (tok.type == token::OPEN) {
-                /* special case for a list of blocks (only matters for savegames) */
-
-                /* NOTE: technically, due to the structure of the language, we could NOT check
-                   for a double-open at all and still handle lists of blocks. this is because no
-                   well-formed PDX script will ever have an EQ token following an OPEN, so a
-                   list is always detected and the lookahead mechanism functions as
-                   expected. nevertheless, in the interest of the explicit... */
-
-                double_open = true;
-            }
-
-            lex.save_and_lookahead(&tok);
-
-            if (tok.type != token::EQ || double_open)
-                val = object{ std::make_unique<list>(lex) }; // by God, this is (probably) a list!
-            else
-                val = object{ std::make_unique<block>(lex) }; // presumably block, so recurse
-
-            /* ... will handle its own closing brace */
-        }
-        else if (tok.type == token::STR || tok.type == token::QSTR)
-            val = object{ lex.strdup(tok.text) };
-        else if (tok.type == token::QDATE || tok.type == token::DATE)
-            val = object{ date{ tok.text, lex.location(), lex.errors() } };
-        else if (tok.type == token::DECIMAL)
-            val = object{ fp3{ tok.text, lex.location(), lex.errors() } };
-        else if (tok.type == token::INTEGER)
-            val = object{ atoi(tok.text) };
-        else
-            lex.unexpected_token(tok);
-
-        // TODO: RHS (val) should support fixed-point decimal types; I haven't decided whether to make integers
-        // and fixed-point decimal all use the same 64-bit type yet.
-
-        _vec.emplace_back(key, val);
-    }
-}
-
-
 void object::destroy() noexcept {
     switch (type) {
         case STRING:
@@ -141,90 +43,52 @@ object& object::operator=(object&& other) {
 }
 
 
-list::list(parser& lex) {
-    token t;
-
-    while (true) {
-        lex.next(&t);
-
-        if (t.type == token::QSTR || t.type == token::STR)
-            _vec.emplace_back( lex.strdup(t.text) );
-        else if (t.type == token::INTEGER)
-            _vec.emplace_back( atoi(t.text) );
-        else if (t.type == token::DECIMAL)
-            _vec.emplace_back( fp3{ t.text, lex.location(), lex.errors() } );
-        else if (t.type == token::OPEN)
-            _vec.emplace_back( std::make_unique<block>(lex) );
-        else if (t.type != token::CLOSE)
-            lex.unexpected_token(t);
-        else
-            return;
-    }
-}
+/* the conversion routines for dates & decimals want a mutable, NUL-terminated string (which they chop up), whereas
+   token text is a reference into the lexer's input buffer. such tokens are short, so we just copy them to the stack
+   rather than ever write to the input buffer. */
+class scratch_text {
+    char _buf[64];
+    std::string _big; // fallback for the rare token which is any longer than that
+    char* _p;
+
+public:
+    scratch_text(const token& t) {
+        if (t.len < sizeof(_buf))
+            _p = &_buf[0];
+        else {
+            _big.resize(t.len + 1);
+            _p = &_big[0];
+        }
 
-void parser::next_expected(token* p_tok, uint type) {
-    next(p_tok);
+        memcpy(_p, t.text, t.len);
+        _p[t.len] = '\0';
+    }
 
-    if (p_tok->type != type)
-        throw va_error("Expected %s token but got token %s at %s:L%d",
-                                     token::TYPE_MAP[type], p_tok->type_name(), pathname(), line());
-}
+    char* get() noexcept { return _p; }
+};
 
 
-void parser::unexpected_token(const token& t) const {
-    throw va_error("Unexpected token %s at %s:L%d",
-                                 t.type_name(), pathname(), line());
+int token_to_integer(const token& t) {
+    scratch_text s(t);
+    return atoi(s.get());
 }
 
 
-void parser::next(token* p_tok, bool eof_ok) {
-    while (1) {
-        switch (_state) {
-            case NORMAL:
-                lexer::next(p_tok);
-                break;
-            case TOK1:
-                p_tok->type = _tok1.type;
-                p_tok->text = _tok1.text;
-                _state = TOK2;
-                break;
-            case TOK2:
-                p_tok->type = _tok2.type;
-                p_tok->text = _tok2.text;
-                _state = NORMAL;
-                break;
-        }
-
-        if (p_tok->type == token::END) {
-            if (!eof_ok)
-                throw va_error("Unexpected EOF at %s:L%d", pathname(), line());
-            else
-                return;
-        }
-
-        if (p_tok->type == token::FAIL)
-            throw va_error("Unrecognized token at %s:L%d", pathname(), line());
-
-        if (p_tok->type == token::COMMENT)
-            continue;
-
-        return;
-    }
+date token_to_date(const token& t, const file_location& loc, error_queue& errors) {
+    scratch_text s(t);
+    return date{ s.get(), loc, errors };
 }
 
 
-void parser::save_and_lookahead(token* p_tok) {
-    /* save our two tokens of lookahead */
-    _tok1.type = p_tok->type;
-    strcpy(_tok1.text, p_tok->text); // buffer overflows are myths
-
-    next(p_tok);
+fp3 token_to_decimal(const token& t, const file_location& loc, error_queue& errors) {
+    scratch_text s(t);
+    return fp3{ s.get(), loc, errors };
+}
 
-    _tok2.type = p_tok->type;
-    strcpy(_tok2.text, p_tok->text);
 
-    /* set lexer to read from the saved tokens first */
-    _state = TOK1;
+void throw_unexpected_token(const token& t, const char* pathname, uint line) {
+    throw va_error("Unexpected token %s at %s:L%d",
+                   t.type_name(), pathname, line);
 }
 
 
@@ -254,10 +118,15 @@ void statement::print(std::ostream& os, uint indent) const {
 void object::print(std::ostream& os, uint indent) const {
 
     if (type == STRING) {
-        if (strpbrk(as_string(), " \t\r\n\'"))
-            os << '"' << as_string() << '"';
-        else
-            os << as_string();
+        const bool quote = strpbrk(as_string(), " \t\r\n\'");
+
+        if (quote)
+            os << '"';
+
+        os.write(as_string(), std::streamsize(string_length()));
+
+        if (quote)
+            os << '"';
     }
     else if (type == INTEGER)
         os << as_integer();
@@ -6,6 +6,9 @@
 #include "error_queue.h"
 #include "cstr_pool.h"
 #include "lexer.h"
+#include "stream_lexer.h"
+#include "binary_lexer.h"
+#include "brace_index.h"
 #include "date.h"
 #include "fp_decimal.h"
 #include "token.h"
@@ -14,6 +17,7 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <boost/filesystem.hpp>
 
 
@@ -28,7 +32,8 @@ typedef fp_decimal<3> fp3;
 
 class block;
 class list;
-class parser;
+template<class TokenSource, class Policy> class basic_parser;
+class tree_image_reader;
 
 class object {
     enum {
@@ -84,6 +89,8 @@ public:
 
     /* data accessors (unchecked type) */
     char*  as_string()  const noexcept { return data.s; }
+    size_t string_length() const noexcept { return cstr_pool<char>::length(data.s); } // (cached alongside it)
+    uint32_t string_hash() const noexcept { return cstr_pool<char>::hash(data.s); }
     int    as_integer() const noexcept { return data.i; }
     date   as_date()    const noexcept { return data.d; }
     fp3    as_decimal() const noexcept { return data.f; }
@@ -93,7 +100,9 @@ public:
 
     /* convenience equality operator overloads */
     bool operator==(const char* s)        const noexcept { return is_string() && strcmp(as_string(), s) == 0; }
-    bool operator==(const std::string& s) const noexcept { return is_string() && s == as_string(); }
+    bool operator==(const std::string& s) const noexcept {
+        return is_string() && s.size() == string_length() && memcmp(s.data(), as_string(), s.size()) == 0;
+    }
     bool operator==(int i)  const noexcept { return is_integer() && as_integer() == i; }
     bool operator==(date d) const noexcept { return is_date() && as_date() == d; }
     bool operator==(fp3 f)  const noexcept { return is_number() && as_number() == f; }
@@ -108,9 +117,11 @@ class list {
     typedef std::vector<object> vec_t;
     vec_t _vec;
 
+    template<class TokenSource, class Policy> friend class basic_parser;
+    friend class tree_image_reader;
+
 public:
-    list() = delete;
-    list(parser&);
+    list() { }
 
     void print(std::ostream&, uint indent = 0) const;
 
@@ -148,9 +159,11 @@ class block {
     typedef std::vector<statement> vec_t;
     vec_t _vec;
 
+    template<class TokenSource, class Policy> friend class basic_parser;
+    friend class tree_image_reader;
+
 public:
     block() { }
-    block(parser&, bool is_root = false, bool is_save = false);
 
     void print(std::ostream&, uint indent = 0) const;
 
@@ -162,50 +175,130 @@ public:
 };
 
 
-/* PARSER -- construct a parse tree whose resources are owned by the parser via the parser's constructor */
+/* PARSE_OPTIONS -- knobs for the parser which most callers needn't touch */
+
+struct parse_options {
+    uint max_depth; // blocks & lists nested any deeper than this are treated as a parse error
+    bool presize;   // count every block's & list's children in a pre-pass, so that their storage is allocated exactly once
+    cstr_pool<char>* p_strings; // where to put strings instead of the parser's own pool, so that they may outlive it
+                                // (e.g., a string_store::writer's); only ever used from the parsing thread
+
+    parse_options() : max_depth(512), presize(false), p_strings(nullptr) {}
+};
+
+
+/* TOKEN CONVERSION -- token text is a reference into the source's input buffer, not a NUL-terminated string */
+
+int  token_to_integer(const token&);
+date token_to_date(const token&, const file_location&, error_queue&);
+fp3  token_to_decimal(const token&, const file_location&, error_queue&);
+
+[[noreturn]] void throw_unexpected_token(const token&, const char* pathname, uint line);
+
+
+/* TOKEN SOURCES -- basic_parser is a template over where its tokens come from. a TokenSource must provide:
+ *
+ *   bool next(token*);                      // the next token, or else token::END (returning false) once exhausted
+ *   const char* pathname() const;           // for diagnostics
+ *   uint line() const;                      // line of the token last returned by next() (may be computed lazily)
+ *   const file_location& location() const;  // location of the token last returned by next()
+ *   const char* input() const;              // raw script text for brace_index, or nullptr if there isn't any
+ *   size_t input_size() const;
+ *
+ * and it must be constructible from a single argument. token text must stay valid until the parser is done with it,
+ * which may be as long as LOOKAHEAD-1 further calls to next(). pdx::lexer is the flex-based source of script text, and
+ * pdx::stream_lexer is its counterpart for input which is only available a piece at a time (e.g., zipped savegames).
+ * pdx::binary_lexer decodes binary (ironman) savegames.
+ */
+
+
+/* PARSE POLICIES -- compile-time choice of dialect */
+
+struct script_policy {
+    static const bool is_save = false;
+};
+
+struct savegame_policy {
+    static const bool is_save = true; // leading "CK2txt" header, and the top level is terminated by a closing brace
+};
+
+
+/* BASIC_PARSER -- construct a parse tree whose resources are owned by the parser via the parser's constructor */
 
-class parser : public lexer {
-    struct saved_token : public token {
-        char buf[128];
-        saved_token() : token(token::END, &buf[0]) { }
+template<class TokenSource, class Policy = script_policy>
+class basic_parser : public TokenSource {
+    /* lookahead ring: tokens which have been lexed but not yet consumed. since tokens refer to their text in-place
+       within the source's (stable) input buffer, buffering them is free. */
+    static const uint LOOKAHEAD = 4; // maximum depth of peek(); must be a power of 2
+    token _ring[LOOKAHEAD];
+    uint  _ring_head; // index of the next token to be consumed
+    uint  _ring_sz;   // number of tokens currently buffered
+
+    /* an open block or list on the parse stack (exactly one of the two is non-null) */
+    struct frame {
+        block* p_block;
+        list*  p_list;
     };
 
-    enum {
-        NORMAL, // read from lexer::next(...)
-        TOK1,   // read from tok1, then tok2
-        TOK2,   // read from tok2, then lexer::next()
-    } _state;
+    uint _max_depth;
+    bool _presize;
+    uint _n_braces; // number of OPEN tokens consumed by parse() thus far
 
-    saved_token _tok1;
-    saved_token _tok2;
+    uint next_brace() noexcept { return ++_n_braces; } // index of the brace just consumed within parse()'s brace_index
 
     cstr_pool<char> _string_pool;
+    cstr_pool<char>* _p_strings; // either that or parse_options::p_strings
     unique_ptr<block> _up_root_block;
     error_queue _errors;
 
-protected:
-    friend class block;
-    friend class list;
+    void lex_into(token*, bool eof_ok);
+    void parse(block* p_root);
+    void push_frame(std::vector<frame>&, const frame&);
+    static void presize(const brace_index&, block*, uint brace);
+    static void presize(const brace_index&, list*, uint brace);
 
-    char* strdup(const char* s) { return _string_pool.strdup(s); }
+protected:
+    /* token text is not NUL-terminated within the input buffer, so these take care of that on the way out. numbers
+       from a binary source come already decoded. */
+    char* strdup(const token& t) { return _p_strings->strdup(t.text, t.len); }
+    int   to_integer(const token& t) { return (t.text) ? token_to_integer(t) : t.value; }
+    date  to_date(const token& t)    { return token_to_date(t, this->location(), _errors); }
+    fp3   to_decimal(const token& t) { return (t.text) ? token_to_decimal(t, this->location(), _errors) : fp3::from_scaled(t.value); }
 
     void next(token*, bool eof_ok = false);
     void next_expected(token*, uint type);
-    void unexpected_token(const token&) const;
-    void save_and_lookahead(token*);
+    void unexpected_token(const token& t) const { throw_unexpected_token(t, this->pathname(), this->line()); }
+    const token& peek(uint depth = 0);
 
 public:
-    parser() = delete;
-    parser(const char* p, bool is_save = false)
-        : lexer(p), _state(NORMAL) { _up_root_block = std::make_unique<block>(*this, true, is_save); }
-    parser(const std::string& p, bool is_save = false) : parser(p.c_str(), is_save) {}
-    parser(const fs::path& p, bool is_save = false) : parser(p.string().c_str(), is_save) {}
+    typedef TokenSource source_type;
+    typedef Policy policy_type;
+
+    basic_parser() = delete;
+
+    /* (constrained so as not to hijack copying, nor to defer a bad argument's error to deep within TokenSource) */
+    template<class SourceArg,
+             class = std::enable_if_t<std::is_constructible_v<TokenSource, SourceArg&&>
+                                      && !std::is_same_v<std::decay_t<SourceArg>, basic_parser>>>
+    basic_parser(SourceArg&& src, const parse_options& opts = parse_options())
+        : TokenSource(std::forward<SourceArg>(src)),
+          _ring_head(0), _ring_sz(0), _max_depth(opts.max_depth), _presize(opts.presize), _n_braces(0),
+          _p_strings((opts.p_strings) ? opts.p_strings : &_string_pool), _up_root_block(std::make_unique<block>()) {
+        parse(_up_root_block.get());
+    }
 
     block* root_block() noexcept { return _up_root_block.get(); }
     error_queue& errors() noexcept { return _errors; }
 };
 
 
+typedef basic_parser<lexer, script_policy>   parser;
+typedef basic_parser<lexer, savegame_policy> save_parser;
+typedef basic_parser<stream_lexer, script_policy>   stream_parser;
+typedef basic_parser<stream_lexer, savegame_policy> stream_save_parser;
+typedef basic_parser<binary_lexer, savegame_policy> binary_save_parser;
+
+
 /* MISC. UTILITY */
 
 static const uint TIER_BARON   = 1;
@@ -241,3 +334,253 @@ inline std::ostream& operator<<(std::ostream& os, const pdx::block& a) { a.print
 inline std::ostream& operator<<(std::ostream& os, const pdx::list& a) { a.print(os); return os; }
 inline std::ostream& operator<<(std::ostream& os, const pdx::statement& a) { a.print(os); return os; }
 inline std::ostream& operator<<(std::ostream& os, const pdx::object& a) { a.print(os); return os; }
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* BASIC_PARSER IMPLEMENTATION */
+
+/* build the parse tree under p_root. rather than recursing for every level of nesting, this drives a single loop from
+   an explicit stack of the currently-open blocks & lists (whose depth is bounded by parse_options::max_depth). each
+   iteration of the loop consumes one statement of the innermost open block or one element of the innermost open list. */
+template<class TokenSource, class Policy>
+void basic_parser<TokenSource, Policy>::parse(block* p_root) {
+
+    if constexpr (Policy::is_save) {
+        /* skip over CK2txt header (savegames only) */
+        token t;
+        next_expected(&t, token::STR);
+    }
+
+    /* only needed while parsing, so it isn't kept along with the tree (for a big savegame, it's megabytes) */
+    brace_index braces; // only built if _presize
+
+    if (_presize && this->input()) {
+        braces.build(this->input(), this->input_size());
+        p_root->_vec.reserve( braces.top_level().statements );
+    }
+
+    std::vector<frame> stack;
+    stack.reserve(32);
+    stack.push_back({ p_root, nullptr });
+
+    while (!stack.empty()) {
+        token tok;
+
+        if (list* p_list = stack.back().p_list) {
+            next(&tok);
+
+            if (tok.type == token::QSTR || tok.type == token::STR)
+                p_list->_vec.emplace_back( strdup(tok) );
+            else if (tok.type == token::INTEGER)
+                p_list->_vec.emplace_back( to_integer(tok) );
+            else if (tok.type == token::DECIMAL)
+                p_list->_vec.emplace_back( to_decimal(tok) );
+            else if (tok.type == token::OPEN) {
+                auto up_block = std::make_unique<block>();
+                block* p_block = up_block.get();
+                presize(braces, p_block, next_brace());
+                p_list->_vec.emplace_back( std::move(up_block) );
+                push_frame(stack, { p_block, nullptr });
+            }
+            else if (tok.type != token::CLOSE)
+                unexpected_token(tok);
+            else
+                stack.pop_back();
+
+            continue;
+        }
+
+        block* p_block = stack.back().p_block;
+        const bool is_root = (stack.size() == 1);
+
+        next(&tok, is_root);
+
+        if (tok.type == token::END) {
+            stack.pop_back();
+            continue;
+        }
+
+        if (tok.type == token::CLOSE) {
+            if (is_root && !Policy::is_save) // closing braces are only bad at root level
+                throw va_error("Unmatched closing brace in %s (before line %u)",
+                               this->pathname(), this->line());
+
+            // otherwise, they mean it's time return to the previous block
+            stack.pop_back();
+            continue;
+        }
+
+        object key;
+
+        if (tok.type == token::STR)
+            key = object{ strdup(tok) };
+        else if (tok.type == token::DATE)
+            key = object{ to_date(tok) };
+        else if (tok.type == token::INTEGER)
+            key = object{ to_integer(tok) };
+        else
+            unexpected_token(tok);
+
+        /* ...done with key */
+
+        next_expected(&tok, token::EQ);
+
+        /* on to value... */
+        object val;
+        next(&tok);
+
+        if (tok.type == token::OPEN) {
+            const uint brace = next_brace();
+
+            /* need to peek ahead 2 tokens to determine whether this is opening a generic list or a
+               nested block of statements */
+
+            const token& la1 = peek(0);
+
+            if (la1.type == token::CLOSE) {
+                /* empty block */
+                next(&tok);
+                val = object{ std::make_unique<block>() };
+                p_block->_vec.emplace_back(key, val);
+                continue;
+            }
+
+            /* a double-open is the special case of a list of blocks (only matters for savegames).
+
+               NOTE: technically, due to the structure of the language, we could NOT check for a
+               double-open at all and still handle lists of blocks. this is because no well-formed
+               PDX script will ever have an EQ token following an OPEN, so a list is always
+               detected and the lookahead functions as expected. nevertheless, in the interest of
+               the explicit... */
+
+            bool double_open = (la1.type == token::OPEN);
+            frame child{ nullptr, nullptr };
+
+            if (peek(1).type != token::EQ || double_open) {
+                auto up_list = std::make_unique<list>(); // by God, this is (probably) a list!
+                child.p_list = up_list.get();
+                presize(braces, child.p_list, brace);
+                val = object{ std::move(up_list) };
+            }
+            else {
+                auto up_block = std::make_unique<block>(); // presumably block
+                child.p_block = up_block.get();
+                presize(braces, child.p_block, brace);
+                val = object{ std::move(up_block) };
+            }
+
+            /* the child is filled in-place once it's atop the stack, and it will handle its own closing brace */
+            p_block->_vec.emplace_back(key, val);
+            push_frame(stack, child);
+            continue;
+        }
+        else if (tok.type == token::STR || tok.type == token::QSTR)
+            val = object{ strdup(tok) };
+        else if (tok.type == token::QDATE || tok.type == token::DATE)
+            val = object{ to_date(tok) };
+        else if (tok.type == token::DECIMAL)
+            val = object{ to_decimal(tok) };
+        else if (tok.type == token::INTEGER)
+            val = object{ to_integer(tok) };
+        else
+            unexpected_token(tok);
+
+        // TODO: RHS (val) should support fixed-point decimal types; I haven't decided whether to make integers
+        // and fixed-point decimal all use the same 64-bit type yet.
+
+        p_block->_vec.emplace_back(key, val);
+    }
+}
+
+
+/* reserve exact capacity for the block or list opened by the given brace, if we've built a brace_index (the counts are
+   hints, so we're careful not to trust one which has somehow fallen out of step with the lexer) */
+template<class TokenSource, class Policy>
+void basic_parser<TokenSource, Policy>::presize(const brace_index& braces, block* p_block, uint brace) {
+    if (brace < braces.size())
+        p_block->_vec.reserve( braces[brace].statements );
+}
+
+
+template<class TokenSource, class Policy>
+void basic_parser<TokenSource, Policy>::presize(const brace_index& braces, list* p_list, uint brace) {
+    if (brace < braces.size())
+        p_list->_vec.reserve( braces[brace].elements );
+}
+
+
+template<class TokenSource, class Policy>
+void basic_parser<TokenSource, Policy>::push_frame(std::vector<frame>& stack, const frame& f) {
+    if (stack.size() >= _max_depth)
+        throw va_error("Blocks & lists nested deeper than the maximum of %u at %s:L%d",
+                       _max_depth, this->pathname(), this->line());
+
+    stack.push_back(f);
+}
+
+
+template<class TokenSource, class Policy>
+void basic_parser<TokenSource, Policy>::next_expected(token* p_tok, uint type) {
+    next(p_tok);
+
+    if (p_tok->type != type)
+        throw va_error("Expected %s token but got token %s at %s:L%d",
+                       token::TYPE_MAP[type], p_tok->type_name(), this->pathname(), this->line());
+}
+
+
+/* lex the next token which is of any interest to the parser into *p_tok */
+template<class TokenSource, class Policy>
+void basic_parser<TokenSource, Policy>::lex_into(token* p_tok, bool eof_ok) {
+    while (1) {
+        TokenSource::next(p_tok);
+
+        if (p_tok->type == token::END) {
+            if (!eof_ok)
+                throw va_error("Unexpected EOF at %s:L%d", this->pathname(), this->line());
+            else
+                return;
+        }
+
+        if (p_tok->type == token::FAIL)
+            throw va_error("Unrecognized token at %s:L%d", this->pathname(), this->line());
+
+        if (p_tok->type == token::COMMENT)
+            continue;
+
+        return;
+    }
+}
+
+
+template<class TokenSource, class Policy>
+void basic_parser<TokenSource, Policy>::next(token* p_tok, bool eof_ok) {
+    if (_ring_sz == 0) {
+        lex_into(p_tok, eof_ok);
+        return;
+    }
+
+    *p_tok = _ring[_ring_head];
+    _ring_head = (_ring_head + 1) & (LOOKAHEAD - 1);
+    --_ring_sz;
+}
+
+
+/* peek at the token `depth` tokens past the next one to be consumed, lexing ahead as necessary. the returned reference
+   is valid until that token is consumed. */
+template<class TokenSource, class Policy>
+const token& basic_parser<TokenSource, Policy>::peek(uint depth) {
+    assert(depth < LOOKAHEAD && "parser lookahead ring is too shallow");
+
+    while (_ring_sz <= depth) {
+        lex_into(&_ring[ (_ring_head + _ring_sz) & (LOOKAHEAD - 1) ], false);
+        ++_ring_sz;
+    }
+
+    return _ring[ (_ring_head + depth) & (LOOKAHEAD - 1) ];
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,329 @@
+#include "path_index.h"
+#include "binary_file.h"
+#include "error.h"
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <algorithm>
+#include <cstdio>
+
+#ifdef __linux__
+#include <sys/stat.h>
+#endif
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* a file or folder found in a layer */
+struct found_path {
+    std::string path; // virtual path (generic form)
+    bool is_dir;
+
+    bool operator<(const found_path& o) const noexcept { return path < o.path; }
+};
+
+typedef std::vector<std::vector<found_path>> found_list; // by layer
+
+static const file_magic FILE_MAGIC = { 'p', 'd', 'x', 'd', 'i', 'r', 's', '1' };
+
+
+/* false if it's not a directory (or it's gone) */
+static bool stat_dir(const fs::path& real_path, int64_t* p_mtime) {
+#ifdef __linux__
+    struct stat st;
+
+    if (::stat(real_path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        return false;
+
+    *p_mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#else
+    boost::system::error_code ec;
+
+    if (!fs::is_directory(real_path, ec))
+        return false;
+
+    *p_mtime = int64_t(fs::last_write_time(real_path, ec)) * 1000000000;
+
+    if (ec)
+        return false;
+#endif
+
+    return true;
+}
+
+
+static void read_dir(std::vector<dir_cache::dir_entry>* p_entries, const fs::path& real_path) {
+    boost::system::error_code ec;
+
+    for (fs::directory_iterator it(real_path, ec), end; !ec && it != end; it.increment(ec)) {
+        const fs::file_status st = it->status();
+
+        if (fs::is_directory(st))
+            p_entries->push_back({ it->path().filename().string(), true });
+        else if (fs::is_regular_file(st))
+            p_entries->push_back({ it->path().filename().string(), false });
+    }
+}
+
+
+/* walk every folder layer, a directory per task, in parallel. each task's subdirectories become tasks of their own, so
+   the walk is done once the queue is empty & no task is still being read. a directory whose listing is in *p_cache
+   (if any) under its current mtime is only statted, not read. */
+static void walk(found_list* p_found, const std::vector<fs::path>& roots,
+                 const std::vector<const zip_archive*>& archives, dir_cache* p_cache) {
+    struct task {
+        size_t layer;
+        std::string dir; // virtual path, empty for the layer's root
+    };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<task> queue;
+    uint n_busy = 0;
+
+    for (size_t i = 0; i < roots.size(); ++i)
+        if (archives[i] == nullptr)
+            queue.push_back({ i, std::string() });
+
+    auto work = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            cv.wait(lock, [&] { return !queue.empty() || n_busy == 0; });
+
+            if (queue.empty())
+                break;
+
+            const task t = std::move(queue.front());
+            queue.pop_front();
+            ++n_busy;
+            lock.unlock();
+
+            const fs::path real_dir = roots[t.layer] / t.dir;
+            std::vector<dir_cache::dir_entry> entries;
+            int64_t mtime = 0;
+            const bool is_dir = stat_dir(real_dir, &mtime); // (before reading, lest a change in between be missed)
+            bool cached = false;
+
+            if (p_cache && is_dir) {
+                std::lock_guard<std::mutex> cache_lock(mutex);
+                cached = p_cache->get(&entries, real_dir.string(), mtime);
+            }
+
+            if (is_dir && !cached)
+                read_dir(&entries, real_dir);
+
+            lock.lock();
+
+            if (p_cache && is_dir && !cached)
+                p_cache->put(real_dir.string(), mtime, entries);
+
+            for (auto& e : entries) {
+                std::string path = (t.dir.empty()) ? std::move(e.name) : t.dir + "/" + e.name;
+
+                if (e.is_dir)
+                    queue.push_back({ t.layer, path });
+
+                (*p_found)[t.layer].push_back({ std::move(path), e.is_dir });
+            }
+
+            --n_busy;
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (uint i = 1; i < path_index::N_THREADS; ++i)
+        threads.emplace_back(work);
+
+    work();
+
+    for (auto&& t : threads)
+        t.join();
+}
+
+
+path_index::path_index(const std::vector<fs::path>& roots, const std::vector<const zip_archive*>& archives,
+                       dir_cache* p_cache) {
+    found_list found(roots.size());
+    walk(&found, roots, archives, p_cache);
+
+    for (size_t i = 0; i < roots.size(); ++i) {
+        if (archives[i] == nullptr)
+            continue;
+
+        for (const auto& m : archives[i]->members())
+            if (!m.name.empty() && m.name.back() != '/')
+                found[i].push_back({ m.name, false });
+    }
+
+    /* layers in order of priority, so that higher ones replace lower ones, and in order of path within each so that
+       which of two paths differing only in case wins doesn't depend upon the walk */
+    for (size_t i = 0; i < roots.size(); ++i) {
+        std::sort(found[i].begin(), found[i].end());
+
+        for (auto& f : found[i]) {
+            std::vector<entry>& v = _map[fold(f.path)];
+
+            if (v.empty()) {
+                v.push_back({ i, std::move(f.path) });
+                continue;
+            }
+
+            const entry& e = v.front();
+
+            if (!f.is_dir && e.path != f.path) {
+                const std::string a = (roots[i] / f.path).string();
+                const std::string b = (roots[e.layer] / e.path).string();
+
+                _warnings.push_back((e.layer == i) ? b + " and " + a + " differ only in case; using the former"
+                                                   : a + " overrides " + b + ", which differs only in case");
+            }
+
+            /* a higher layer's path wins, going first; one in the same layer goes after those already there */
+            v.insert(std::find_if(v.begin(), v.end(), [i](const entry& o) { return o.layer != i; }),
+                     { i, std::move(f.path) });
+        }
+    }
+}
+
+
+const path_index::entry* path_index::find(const std::string& virtual_path) const {
+    const std::vector<entry>* p_all = find_all(virtual_path);
+    return (p_all) ? &p_all->front() : nullptr;
+}
+
+
+const std::vector<path_index::entry>* path_index::find_all(const std::string& virtual_path) const {
+    auto it = _map.find(fold(virtual_path));
+    return (it != _map.end()) ? &it->second : nullptr;
+}
+
+
+std::string path_index::fold(std::string s) {
+    for (auto& c : s)
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+
+    return s;
+}
+
+
+bool dir_cache::get(std::vector<dir_entry>* p_entries, const std::string& real_path, int64_t mtime) {
+    auto it = _map.find(real_path);
+
+    if (it == _map.end() || it->second.mtime != mtime)
+        return false;
+
+    it->second.used = true;
+    *p_entries = it->second.entries;
+    return true;
+}
+
+
+void dir_cache::put(const std::string& real_path, int64_t mtime, const std::vector<dir_entry>& entries) {
+    _map[real_path] = { mtime, entries, true };
+    ++_n_dirs_read;
+}
+
+
+/* CACHE FILE
+ *
+ * a magic number, a listing count, and then for each listing its directory's path (length-prefixed), its mtime, an
+ * entry count, and its entries, each a type byte (1 for a directory) & a name (length-prefixed). all in host byte
+ * order, as for the fingerprint cache.
+ */
+
+void dir_cache::save(const fs::path& path) const {
+    /* (written alongside & renamed into place, so that an interrupted save can't leave a truncated cache) */
+    write_file_atomically(path, [&](std::FILE* f) {
+        auto write_string = [&](const std::string& s) {
+            const uint32_t len = uint32_t(s.size());
+            return std::fwrite(&len, sizeof(len), 1, f) == 1 && std::fwrite(s.data(), 1, len, f) == len;
+        };
+
+        uint64_t n = 0;
+
+        for (const auto& e : _map)
+            if (e.second.used)
+                ++n;
+
+        bool ok = write_magic(f, FILE_MAGIC) && std::fwrite(&n, sizeof(n), 1, f) == 1;
+
+        for (auto it = _map.begin(); ok && it != _map.end(); ++it) {
+            const listing& l = it->second;
+
+            if (!l.used)
+                continue;
+
+            const uint32_t n_entries = uint32_t(l.entries.size());
+
+            ok = write_string(it->first)
+              && std::fwrite(&l.mtime, sizeof(l.mtime), 1, f) == 1
+              && std::fwrite(&n_entries, sizeof(n_entries), 1, f) == 1;
+
+            for (auto e = l.entries.begin(); ok && e != l.entries.end(); ++e) {
+                const uint8_t is_dir = e->is_dir;
+                ok = std::fwrite(&is_dir, sizeof(is_dir), 1, f) == 1 && write_string(e->name);
+            }
+        }
+
+        return ok;
+    });
+}
+
+
+void dir_cache::load(const fs::path& path) {
+    const std::string pathname = path.string();
+    file_ptr f = open_with_magic(path, FILE_MAGIC, "a directory cache");
+
+    auto read_string = [&](std::string* p_s) {
+        uint32_t len;
+
+        if (std::fread(&len, sizeof(len), 1, f.get()) != 1)
+            return false;
+
+        p_s->resize(len);
+        return std::fread(&(*p_s)[0], 1, len, f.get()) == len;
+    };
+
+    uint64_t n;
+
+    if (std::fread(&n, sizeof(n), 1, f.get()) != 1)
+        throw va_error("Truncated directory cache: %s", pathname.c_str());
+
+    std::string key;
+
+    for (uint64_t i = 0; i < n; ++i) {
+        listing l;
+        uint32_t n_entries;
+        l.used = false;
+
+        if (!read_string(&key)
+            || std::fread(&l.mtime, sizeof(l.mtime), 1, f.get()) != 1
+            || std::fread(&n_entries, sizeof(n_entries), 1, f.get()) != 1)
+            throw va_error("Truncated directory cache: %s", pathname.c_str());
+
+        l.entries.resize(n_entries);
+
+        for (auto& e : l.entries) {
+            uint8_t is_dir;
+
+            if (std::fread(&is_dir, sizeof(is_dir), 1, f.get()) != 1 || !read_string(&e.name))
+                throw va_error("Truncated directory cache: %s", pathname.c_str());
+
+            e.is_dir = (is_dir != 0);
+        }
+
+        /* what we've listed this run is at least as fresh as what's on disk */
+        _map.emplace(key, std::move(l));
+    }
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,117 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+#include "zip_archive.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* path_index -- every file & folder in a stack of vfs layers, by case-folded virtual path, so that a path may be
+ * resolved in any casing with one hash lookup (as the game does on Windows, where mods are written) rather than by
+ * statting, let alone scanning directories. built by one walk of all the layers at once, with a directory per task
+ * across a pool of threads (as it's mostly waiting on the filesystem, even on one core). zip archive layers are
+ * indexed from their central directories (their files only, as folders within an archive don't otherwise resolve).
+ *
+ * where paths differ only in case, the one in the highest layer wins, as in the game. that's also noted as a warning,
+ * for files, since it may well be a mistake: a mod's file which overrides a vanilla one only case-insensitively, or two
+ * files in the same layer (in which case that which sorts first wins). folding is ASCII-only.
+ *
+ * the paths which lose out to others are kept too, beneath the winner, so that vfs can fall back upon them should the
+ * winner since have been removed. the index is otherwise a snapshot, and vfs checks what it finds against the
+ * filesystem (see vfs::locate). given a dir_cache, rebuilding it costs a stat of each directory, plus reading just
+ * those directories which have changed.
+ */
+class dir_cache;
+
+class path_index {
+public:
+    struct entry {
+        size_t layer;
+        std::string path; // virtual path, as cased in that layer
+    };
+
+    static const uint N_THREADS = 8;
+
+private:
+    std::unordered_map<std::string, std::vector<entry>> _map; // by case-folded virtual path, the winner first
+    std::vector<std::string> _warnings;
+
+public:
+    /* layers (lowest-priority first) are given by root path, along with each one's archive if it's a zip (else null) */
+    path_index(const std::vector<fs::path>& roots, const std::vector<const zip_archive*>& archives,
+               dir_cache* p_cache = nullptr);
+    path_index(const path_index&) = delete;
+
+    /* null if there's no such file or folder, in any casing */
+    const entry* find(const std::string& virtual_path) const;
+
+    /* ...or every one there is, in order of priority (so highest layer first), for as long as the index lives */
+    const std::vector<entry>* find_all(const std::string& virtual_path) const;
+
+    size_t size() const noexcept { return _map.size(); }
+    const std::vector<std::string>& warnings() const noexcept { return _warnings; }
+
+    static std::string fold(std::string);
+};
+
+
+/* dir_cache -- the listings of directories walked by path_index, keyed by real path & validated by the directory's
+ * mtime, which changes whenever an entry is added to, removed from, or renamed within it (though not when a file in it
+ * is merely rewritten, which is of no concern to an index of paths). so a directory needn't be read again for as long
+ * as its mtime is unchanged, and the cache may be saved & reloaded so that holds across runs too: with the game
+ * unchanged, a cold start costs reading the cache file and a stat per directory.
+ *
+ * not thread-safe (path_index serializes its walkers' use of it).
+ *
+ * (mtimes are to the nanosecond on Linux, but may be as coarse as a second elsewhere, where a directory changed within
+ * the same second as it was listed will go unnoticed.)
+ */
+class dir_cache {
+public:
+    struct dir_entry {
+        std::string name;
+        bool is_dir;
+    };
+
+    struct listing {
+        int64_t mtime; // nanoseconds since the epoch (or coarser)
+        std::vector<dir_entry> entries;
+        bool used;     // by an index built this run (only those are saved)
+    };
+
+private:
+    std::unordered_map<std::string, listing> _map; // by real path
+    uint64_t _n_dirs_read;
+
+public:
+    dir_cache() : _n_dirs_read(0) {}
+    dir_cache(const dir_cache&) = delete;
+
+    /* a directory's entries, if they're cached under its current mtime (marking them used) */
+    bool get(std::vector<dir_entry>* p_entries, const std::string& real_path, int64_t mtime);
+
+    /* a directory's entries, as just read */
+    void put(const std::string& real_path, int64_t mtime, const std::vector<dir_entry>& entries);
+
+    /* persist the listings used by any index built from this cache to a file / merge them back in */
+    void save(const fs::path& path) const;
+    void load(const fs::path& path);
+
+    size_t size() const noexcept { return _map.size(); }
+    uint64_t n_dirs_read() const noexcept { return _n_dirs_read; } // directories actually read, over our lifetime
+};
+
+
+_PDX_NAMESPACE_END
@@ -3,11 +3,35 @@
 #pragma once
 #include "pdx_common.h"
 
+#include "hash.h"
+#include "binary_file.h"
+#include "fingerprint.h"
+#include "path_index.h"
 #include "vfs.h"
 #include "date.h"
 #include "fp_decimal.h"
 #include "file_location.h"
 #include "error_queue.h"
 #include "lexer.h"
+#include "stream_lexer.h"
+#include "zip_archive.h"
+#include "file_stream.h"
+#include "inflate_stream.h"
+#include "batch_loader.h"
+#include "token_table.h"
+#include "binary_lexer.h"
 #include "token.h"
+#include "token_list.h"
+#include "string_store.h"
 #include "parser.h"
+#include "parse_cache.h"
+#include "snapshot.h"
+#include "dep_graph.h"
+#include "mod_batch.h"
+#include "file_auditor.h"
+#include "daemon_server.h"
+#include "watcher.h"
+#include "audit_pipeline.h"
+#include "json.h"
+#include "script_document.h"
+#include "lsp_server.h"
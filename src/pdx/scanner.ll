@@ -1,15 +1,34 @@
-
 %option 8bit
 %option warn nodefault
-%option yylineno
 %option noyymore noyywrap
 %option batch
 %option nounistd never-interactive
 
 %top{
+    #include <cstddef>
     #include "token.h"
+
+    /* byte offset just past the end of the last match. we track this instead of using %option yylineno, which costs
+     * a newline test on every matched byte; line numbers are derived on demand (see line_index.h). */
+    extern size_t yyoffset;
+    void yyrestorehold();
+
+    /* where flex refills its buffer from when lexing a stream (see stream_lexer.h). buffers set up by yy_scan_buffer()
+     * never refill, so pdx::lexer doesn't use this. */
+    extern size_t (*yyreader)(char* buf, size_t max_size, void* ctx);
+    extern void* yyreader_ctx;
 }
 
+%{
+    size_t yyoffset = 0;
+    #define YY_USER_ACTION yyoffset += yyleng;
+
+    size_t (*yyreader)(char*, size_t, void*) = nullptr;
+    void* yyreader_ctx = nullptr;
+    #define YY_INPUT(buf, result, max_size) result = (yyreader) ? yyreader(buf, max_size, yyreader_ctx) : 0;
+    #define YY_READ_BUF_SIZE (1 << 18)
+%}
+
 D       [0-9]
 STR     [a-zA-Z\xC0-\xFF0-9_\-\x83\x8A\x8C\x8E\x9A\x9C\x9E\x9F]+
 WS      [ \t\r\n\xA0]+
@@ -31,3 +50,8 @@ DATE    [0-9]{1,4}\.[0-9]{1,2}\.[0-9]{1,2}
 .               { return pdx::token::FAIL; }
 
 %%
+
+/* flex NUL-terminates each match in-place, holding onto the character it overwrote until the next call to yylex().
+ * pdx::token carries its own length, so the lexer puts that character straight back to keep the input buffer intact
+ * between calls (e.g., so that tokens buffered for lookahead stay valid and line_index sees every newline). */
+void yyrestorehold() { *yy_c_buf_p = yy_hold_char; }
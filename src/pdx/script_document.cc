@@ -0,0 +1,377 @@
+#include "script_document.h"
+#include "token.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+script_document::script_document(std::string name, const std::string& text)
+    : _name(std::move(name)), _n_reparsed(0) {
+
+    if (_name.empty())
+        _name = "<memory>";
+
+    assign(text);
+}
+
+
+void script_document::index_lines() {
+    _line_starts.assign(1, 0);
+
+    const char* p = _text.data();
+    const char* end = p + size();
+
+    while (( p = (const char*)memchr(p, '\n', end - p) ) != nullptr)
+        _line_starts.push_back(size_t(++p - _text.data()));
+}
+
+
+void script_document::assign(const std::string& text) {
+    _segments.clear();
+    _defs.clear();
+
+    _text.assign(text.cbegin(), text.cend());
+    _text.push_back('\0');
+    _text.push_back('\0');
+    index_lines();
+
+    size_t resync;
+    _segments = segment_text(0, 0, 0, 0, &resync);
+
+    for (auto& up : _segments) {
+        parse(up.get());
+        add_defs(up.get());
+    }
+
+    _n_reparsed = _segments.size();
+}
+
+
+void script_document::edit(size_t begin, size_t end, const std::string& text) {
+    end = std::min(end, size());
+    begin = std::min(begin, end);
+
+    /* the first segment the edit could affect is the first to end on or after the start of the edit's line, unless
+       any before that were cut short by what followed them */
+    const size_t line_begin = _line_starts[position(begin).first];
+
+    auto it = std::lower_bound(_segments.cbegin(), _segments.cend(), line_begin,
+                               [](const std::unique_ptr<segment>& up, size_t off) { return up->end() < off; });
+
+    size_t first = it - _segments.cbegin();
+
+    while (first > 0 && !_segments[first - 1]->complete)
+        --first;
+
+    const size_t start = (first > 0) ? _segments[first - 1]->end() : 0;
+    const ptrdiff_t delta = ptrdiff_t(text.size()) - ptrdiff_t(end - begin);
+
+    _text.erase(_text.begin() + begin, _text.begin() + end);
+    _text.insert(_text.begin() + begin, text.cbegin(), text.cend());
+    index_lines();
+
+    /* segments [first, resync) are replaced by fresh ones, and the rest merely move */
+    size_t resync;
+    auto fresh = segment_text(start, first, end, delta, &resync);
+
+    for (size_t i = first; i < resync; ++i)
+        remove_defs(_segments[i].get());
+
+    for (size_t i = resync; i < _segments.size(); ++i)
+        _segments[i]->begin += delta;
+
+    for (auto& up : fresh) {
+        parse(up.get());
+        add_defs(up.get());
+    }
+
+    _n_reparsed = fresh.size();
+
+    _segments.erase(_segments.begin() + first, _segments.begin() + resync);
+    _segments.insert(_segments.begin() + first, std::make_move_iterator(fresh.begin()),
+                     std::make_move_iterator(fresh.end()));
+}
+
+
+/* cut the (current) text from start into segments. when replacing old segments from old_first onward, this stops as
+   soon as a segment would begin just where an old one at or after old_resume (i.e., past the edit) began before being
+   shifted by delta, setting *p_resync to that old segment's index; otherwise, it goes to the end of the text. */
+std::vector<std::unique_ptr<script_document::segment>>
+script_document::segment_text(size_t start, size_t old_first, size_t old_resume, ptrdiff_t delta, size_t* p_resync) {
+
+    std::vector<std::unique_ptr<segment>> out;
+    std::unique_ptr<segment> up_seg;
+    size_t old = old_first;
+    *p_resync = _segments.size();
+
+    char* const base = _text.data();
+    lexer lex(memory_span{ base + start, size() - start, _name.c_str() });
+
+    enum { KEY, AFTER_KEY, AFTER_EQ, IN_BRACES } state = KEY;
+    uint depth = 0;
+    token tok, prev(token::END, nullptr, 0);
+    size_t prev_end = 0;
+    bool prev_is_key = false; // prev is a STR which could be a key
+    bool in_id = false;       // just after an `id =` at depth 1 (an event's definition)
+
+    auto finish = [&](size_t end, bool complete) {
+        up_seg->size = end - up_seg->begin;
+        up_seg->complete = complete;
+        out.push_back(std::move(up_seg));
+        state = KEY;
+    };
+
+    auto define = [&](const token& t) {
+        up_seg->defs.emplace_back(std::string(t.text, t.len), uint32_t(t.text - base - up_seg->begin));
+    };
+
+    while (true) {
+        lex.next(&tok);
+
+        if (tok.type == token::COMMENT)
+            continue;
+
+        const bool quoted = (tok.type == token::QSTR || tok.type == token::QDATE);
+        const size_t tok_begin = start + lex.offset();
+        const size_t tok_end = (tok.type == token::END) ? size() : size_t(tok.text - base) + tok.len + quoted;
+
+        if (state == AFTER_KEY) {
+            if (tok.type == token::EQ) {
+                if (prev.type == token::STR || prev.type == token::INTEGER)
+                    define(prev);
+
+                state = AFTER_EQ;
+                continue;
+            }
+
+            finish(prev_end, false); // and this token begins the next segment
+        }
+        else if (state == AFTER_EQ) {
+            if (tok.type == token::OPEN) {
+                state = IN_BRACES;
+                depth = 1;
+                prev_is_key = in_id = false;
+                continue;
+            }
+
+            finish((tok.type == token::END) ? size() : tok_end, tok.type != token::END);
+
+            if (tok.type == token::END)
+                break;
+
+            continue;
+        }
+        else if (state == IN_BRACES) {
+            if (tok.type == token::END) {
+                finish(size(), false);
+                break;
+            }
+
+            if (in_id && (tok.type == token::STR || tok.type == token::QSTR || tok.type == token::INTEGER))
+                define(tok);
+
+            in_id = false;
+
+            if (tok.type == token::EQ && prev_is_key) {
+                const std::string key(prev.text, prev.len);
+
+                if (looks_like_title(key.c_str()))
+                    define(prev);
+                else if (depth == 1 && key == "id")
+                    in_id = true;
+            }
+
+            prev_is_key = (tok.type == token::STR);
+            prev = tok;
+
+            if (tok.type == token::OPEN)
+                ++depth;
+            else if (tok.type == token::CLOSE && --depth == 0)
+                finish(tok_end, true);
+
+            continue;
+        }
+
+        /* KEY: either the end, or the beginning of a new segment */
+
+        if (tok.type == token::END)
+            break;
+
+        auto shifted = [&](size_t i) { return ptrdiff_t(_segments[i]->begin) + delta; };
+
+        while (old < _segments.size() && (_segments[old]->begin < old_resume || shifted(old) < ptrdiff_t(tok_begin)))
+            ++old;
+
+        if (old < _segments.size() && shifted(old) == ptrdiff_t(tok_begin)) {
+            *p_resync = old;
+            break;
+        }
+
+        up_seg = std::make_unique<segment>();
+        up_seg->begin = tok_begin;
+
+        if (tok.type == token::CLOSE) {
+            finish(tok_end, true);
+            continue;
+        }
+
+        prev = tok;
+        prev_end = tok_end;
+        state = AFTER_KEY;
+    }
+
+    return out;
+}
+
+
+/* parse a segment by itself (its text copied, so that it needn't care about later edits) */
+void script_document::parse(segment* p_seg) {
+    p_seg->up_parser.reset();
+    p_seg->diags.clear();
+
+    const char* seg_text = _text.data() + p_seg->begin;
+
+    try {
+        const memory_view view{ std::string_view(seg_text, p_seg->size), _name.c_str() };
+        p_seg->up_parser = std::make_unique<parser>(view);
+
+        for (auto&& e : p_seg->up_parser->errors())
+            p_seg->diags.push_back({ e._location.offset(), false, e._prio == error::WARNING, e.what() });
+    }
+    catch (const std::exception& e) {
+        /* fatal errors only say where they happened as "... at <name>:L<n>" (or "... in <name> (before line <n>)") */
+        std::string msg = e.what();
+        uint line = 1;
+        const size_t pos = msg.rfind(_name);
+
+        if (pos != std::string::npos) {
+            const char* p = msg.c_str() + pos + _name.size();
+
+            if (strncmp(p, ":L", 2) == 0)
+                line = uint(strtoul(p + 2, nullptr, 10));
+            else if (strncmp(p, " (before line ", 14) == 0)
+                line = uint(strtoul(p + 14, nullptr, 10));
+
+            msg.erase(pos);
+
+            for (const char* sep : { " at ", " in " })
+                if (msg.size() >= 4 && msg.compare(msg.size() - 4, 4, sep) == 0)
+                    msg.erase(msg.size() - 4);
+        }
+
+        /* a segment cut short by what followed it (rather than by the end of the text) is a key lacking its '=' */
+        if (!p_seg->complete && p_seg->end() < size() && msg == "Unexpected EOF")
+            msg = "Expected EQ token after key";
+
+        size_t rel = 0;
+
+        for (uint i = 1; i < line; ++i) {
+            const void* nl = memchr(seg_text + rel, '\n', p_seg->size - rel);
+
+            if (nl == nullptr)
+                break;
+
+            rel = (const char*)nl - seg_text + 1;
+        }
+
+        p_seg->diags.push_back({ rel, true, false, std::move(msg) });
+    }
+}
+
+
+void script_document::add_defs(const segment* p_seg) {
+    for (const auto& d : p_seg->defs)
+        _defs[d.first].emplace_back(p_seg, d.second);
+}
+
+
+void script_document::remove_defs(const segment* p_seg) {
+    for (const auto& d : p_seg->defs) {
+        auto it = _defs.find(d.first);
+
+        if (it == _defs.end())
+            continue;
+
+        auto& v = it->second;
+        v.erase(std::remove_if(v.begin(), v.end(), [=](const auto& e) { return e.first == p_seg; }), v.end());
+
+        if (v.empty())
+            _defs.erase(it);
+    }
+}
+
+
+size_t script_document::offset(uint line, uint column) const noexcept {
+    if (line >= _line_starts.size())
+        return size();
+
+    const size_t line_end = (line + 1 < _line_starts.size()) ? _line_starts[line + 1] - 1 : size();
+    return std::min(_line_starts[line] + column, line_end);
+}
+
+
+std::pair<uint, uint> script_document::position(size_t offset) const noexcept {
+    offset = std::min(offset, size());
+    auto it = std::upper_bound(_line_starts.cbegin(), _line_starts.cend(), offset) - 1;
+    return { uint(it - _line_starts.cbegin()), uint(offset - *it) };
+}
+
+
+static bool is_word_char(char c) noexcept {
+    const unsigned char u = c;
+    return (u >= 'a' && u <= 'z') || (u >= 'A' && u <= 'Z') || (u >= '0' && u <= '9') || u == '_' || u == '-'
+        || u >= 0x80;
+}
+
+
+std::pair<size_t, uint> script_document::word_at(size_t offset) const noexcept {
+    const char* s = _text.data();
+    offset = std::min(offset, size());
+
+    /* a cursor just past the end of a word is still on it */
+    if ((offset == size() || !is_word_char(s[offset])) && offset > 0 && is_word_char(s[offset - 1]))
+        --offset;
+
+    size_t begin = offset, end = offset;
+
+    while (begin > 0 && is_word_char(s[begin - 1]))
+        --begin;
+
+    while (end < size() && is_word_char(s[end]))
+        ++end;
+
+    return { begin, uint(end - begin) };
+}
+
+
+std::vector<script_document::diagnostic> script_document::diagnostics() const {
+    std::vector<diagnostic> v;
+
+    for (const auto& up : _segments)
+        for (const auto& d : up->diags)
+            v.push_back({ up->begin + d.offset, d.whole_line, d.warning, d.msg });
+
+    return v;
+}
+
+
+std::vector<script_document::definition> script_document::definitions(const std::string& name) const {
+    std::vector<definition> v;
+    auto it = _defs.find(name);
+
+    if (it == _defs.end())
+        return v;
+
+    for (const auto& e : it->second)
+        v.push_back({ this, e.first->begin + e.second, uint(name.size()) });
+
+    std::sort(v.begin(), v.end(), [](const definition& a, const definition& b) { return a.offset < b.offset; });
+    return v;
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,111 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+#include "parser.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* SCRIPT_DOCUMENT -- the text of a script file being edited, kept parsed as it changes.
+ *
+ * the text is cut into segments, each a single top-level statement (or a stray token which can't begin one), and
+ * every segment is parsed on its own, keeping its tree & diagnostics. an edit re-lexes from the end of the last
+ * segment which it can't have affected up to the first point at which the new token stream falls back into step with
+ * the old segment boundaries (shifted by the edit), and only the segments in between are parsed again. no token spans
+ * a line, so an edit can only change tokens from the start of its own line onward; a segment which was cut short
+ * by what followed it (e.g., a key lacking its '=') is also re-lexed along with the edit.
+ *
+ * each segment also records the names it defines (see definitions()), which are indexed by name for the document.
+ *
+ * offsets are bytes and lines are 0-based, as a language server wants them. since each segment is parsed without the
+ * rest, a fatal parse error only costs the rest of its own segment rather than the rest of the file.
+ */
+
+class script_document {
+public:
+    struct diagnostic {
+        size_t offset;  // of the offending token, or of the start of its line (if whole_line)
+        bool whole_line;
+        bool warning;
+        std::string msg;
+    };
+
+    struct definition {
+        const script_document* p_doc;
+        size_t offset;
+        uint length;
+    };
+
+private:
+    struct segment {
+        size_t begin;
+        size_t size;
+        bool complete;                      // false if where it ends depends upon what follows it
+        std::unique_ptr<parser> up_parser;  // null if the segment failed to parse
+        std::vector<diagnostic> diags;      // offsets relative to begin
+        std::vector<std::pair<std::string, uint32_t>> defs; // name & offset relative to begin
+
+        size_t end() const noexcept { return begin + size; }
+    };
+
+    std::string _name;
+    std::vector<char> _text;          // followed by the 2 NUL bytes the lexer wants (not counted by size())
+    std::vector<size_t> _line_starts; // offset of each line's first byte
+    std::vector<std::unique_ptr<segment>> _segments; // in order of begin, never overlapping
+
+    /* where every defined name is defined, by name */
+    std::unordered_map<std::string, std::vector<std::pair<const segment*, uint32_t>>> _defs;
+
+    uint _n_reparsed; // segments parsed by the last change
+
+    void index_lines();
+    std::vector<std::unique_ptr<segment>> segment_text(size_t start, size_t old_first, size_t old_resume,
+                                                       ptrdiff_t delta, size_t* p_resync);
+    void parse(segment*);
+    void add_defs(const segment*);
+    void remove_defs(const segment*);
+
+public:
+    script_document(std::string name, const std::string& text);
+    script_document(const script_document&) = delete;
+
+    /* replace [begin, end) with text (clamped to the document) */
+    void edit(size_t begin, size_t end, const std::string& text);
+
+    /* replace the whole text */
+    void assign(const std::string& text);
+
+    const std::string& name() const noexcept { return _name; }
+    size_t size() const noexcept { return _text.size() - 2; }
+    const char* text() const noexcept { return _text.data(); }
+
+    /* offset <-> line & column (bytes), clamping either to the document */
+    size_t offset(uint line, uint column) const noexcept;
+    std::pair<uint, uint> position(size_t offset) const noexcept;
+
+    /* the length of the token-like word at offset, and where it begins */
+    std::pair<size_t, uint> word_at(size_t offset) const noexcept;
+
+    /* every diagnostic, in order, with offsets into the document */
+    std::vector<diagnostic> diagnostics() const;
+
+    /* where a name is defined, in order: top-level keys, title keys at any depth, & event IDs */
+    std::vector<definition> definitions(const std::string& name) const;
+
+    size_t n_segments() const noexcept { return _segments.size(); }
+    uint n_reparsed() const noexcept { return _n_reparsed; }
+};
+
+
+_PDX_NAMESPACE_END
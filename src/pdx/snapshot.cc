@@ -0,0 +1,279 @@
+#include "snapshot.h"
+#include "tree_image.h"
+#include "batch_loader.h"
+#include "fingerprint.h"
+#include "binary_file.h"
+#include "error.h"
+
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* IMAGE FORMAT -- a header, the file index (sorted by virtual path), one tree image for all of the files (its nodes,
+ * then its string table), and finally the virtual paths themselves. all in host byte order (see tree_image). */
+
+static const char IMAGE_MAGIC[8] = { 'p', 'd', 'x', 's', 'n', 'a', 'p', '\0' };
+
+struct image_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t n_files;
+    uint64_t n_nodes;
+    uint64_t strings_size;
+    uint64_t names_size;
+};
+
+struct image_file {
+    uint64_t name;    // offset of its virtual path (generic form) in the path table
+    uint64_t root;    // index of its root node
+    uint64_t n_nodes; // in its tree
+    uint64_t size;    // stamp at build time
+    int64_t  mtime;
+};
+
+static_assert(sizeof(image_header) == 40 && sizeof(image_file) == 40, "unexpected padding in snapshot image format");
+
+
+struct snapshot::image {
+    boost::iostreams::mapped_file map;
+    image_header hdr;
+    const image_file* files;
+    const tree_node* nodes;
+    char* strings;
+    const char* names;
+
+    const image_file* find(const std::string& virtual_path) const {
+        const image_file* end = files + hdr.n_files;
+        auto p = std::lower_bound(files, end, virtual_path, [this](const image_file& f, const std::string& s) {
+            return strcmp(names + f.name, s.c_str()) < 0;
+        });
+
+        return (p != end && virtual_path == names + p->name) ? p : nullptr;
+    }
+};
+
+
+/* a tree built from the snapshot, which must be destroyed before the mapping its strings point into */
+struct snapshot_tree {
+    std::shared_ptr<const void> sp_image;
+    std::unique_ptr<block> up_root;
+};
+
+
+/* BUILDING */
+
+uint snapshot::build(const fs::path& game_path, const fs::path& out_path, const error_callback& on_error) {
+    std::vector<fs::path> paths;
+
+    for (fs::recursive_directory_iterator it(game_path), end; it != end; ++it) {
+        if (!fs::is_regular_file(it->status()))
+            continue;
+
+        std::string ext = it->path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+        if (ext == ".txt")
+            paths.push_back(it->path());
+    }
+
+    struct entry {
+        std::string name;
+        image_file file;
+    };
+
+    std::vector<entry> entries;
+    entries.reserve(paths.size());
+    tree_image_writer writer;
+
+    /* files are read in parallel but (the lexer being what it is) parsed one at a time, as each is read */
+    batch_loader loader;
+
+    loader.load(paths, [&](loaded_file& f) {
+        if (f.error) {
+            on_error(f.pathname, strerror(f.error));
+            return;
+        }
+
+        try {
+            const fingerprint stamp = stamp_file(f.pathname);
+            parser parse(f.span());
+
+            if (!parse.errors().empty()) {
+                on_error(f.pathname, parse.errors().begin()->what());
+                return;
+            }
+
+            const uint64_t root = writer.add(*parse.root_block());
+            const std::string name = fs::path(f.pathname).lexically_relative(game_path).generic_string();
+            entries.push_back({ name, { 0, root, writer.nodes().size() - root, stamp.size, stamp.mtime } });
+        }
+        catch (const std::exception& e) {
+            on_error(f.pathname, e.what());
+        }
+    });
+
+    std::sort(entries.begin(), entries.end(), [](const entry& a, const entry& b) { return a.name < b.name; });
+
+    std::string names;
+
+    for (auto&& e : entries) {
+        e.file.name = names.size();
+        names.append(e.name).push_back('\0');
+    }
+
+    image_header hdr;
+    std::copy_n(IMAGE_MAGIC, sizeof(hdr.magic), hdr.magic);
+    hdr.version = VERSION;
+    hdr.n_files = uint32_t(entries.size());
+    hdr.n_nodes = writer.nodes().size();
+    hdr.strings_size = writer.strings().size();
+    hdr.names_size = names.size();
+
+    /* (written alongside & renamed into place, so that an interrupted build can't leave a truncated snapshot) */
+    write_file_atomically(out_path, [&](std::FILE* f) {
+        bool ok = std::fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+
+        for (auto it = entries.cbegin(); ok && it != entries.cend(); ++it)
+            ok = std::fwrite(&it->file, sizeof(it->file), 1, f) == 1;
+
+        ok = ok
+            && std::fwrite(writer.nodes().data(), sizeof(tree_node), hdr.n_nodes, f) == hdr.n_nodes
+            && std::fwrite(writer.strings().data(), 1, hdr.strings_size, f) == hdr.strings_size
+            && std::fwrite(names.data(), 1, hdr.names_size, f) == hdr.names_size;
+
+        return ok;
+    });
+    return hdr.n_files;
+}
+
+
+/* LOADING */
+
+snapshot::snapshot(const fs::path& path) : _sp_image(std::make_shared<image>()) {
+    const std::string pathname = path.string();
+    image& img = *_sp_image;
+
+    try {
+        img.map.open(pathname, boost::iostreams::mapped_file::priv);
+    }
+    catch (const std::exception&) {
+        throw va_error("Could not map file: %s", pathname.c_str());
+    }
+
+    char* p = img.map.data();
+    const uint64_t size = img.map.size();
+
+    if (size < sizeof(img.hdr))
+        throw va_error("Not a snapshot: %s", pathname.c_str());
+
+    memcpy(&img.hdr, p, sizeof(img.hdr));
+    const image_header& hdr = img.hdr;
+
+    if (!std::equal(hdr.magic, hdr.magic + sizeof(hdr.magic), IMAGE_MAGIC))
+        throw va_error("Not a snapshot: %s", pathname.c_str());
+
+    if (hdr.version != VERSION)
+        throw va_error("Snapshot is from another version of this program and must be rebuilt: %s", pathname.c_str());
+
+    /* sizes must add up exactly (each term checked so that none can overflow) */
+    uint64_t left = size - sizeof(hdr);
+    bool ok = hdr.n_files <= left / sizeof(image_file);
+
+    if (ok) {
+        left -= hdr.n_files * sizeof(image_file);
+        ok = hdr.n_nodes <= left / sizeof(tree_node);
+    }
+
+    if (ok) {
+        left -= hdr.n_nodes * sizeof(tree_node);
+        ok = hdr.strings_size <= left && hdr.names_size == left - hdr.strings_size;
+    }
+
+    if (!ok)
+        throw va_error("Corrupt snapshot (truncated): %s", pathname.c_str());
+
+    p += sizeof(hdr);
+    img.files = reinterpret_cast<const image_file*>(p);
+    p += hdr.n_files * sizeof(image_file);
+    img.nodes = reinterpret_cast<const tree_node*>(p);
+    p += hdr.n_nodes * sizeof(tree_node);
+    img.strings = p;
+    img.names = p + hdr.strings_size;
+
+    if (hdr.names_size > 0 && img.names[hdr.names_size - 1] != '\0')
+        throw va_error("Corrupt snapshot (bad path table): %s", pathname.c_str());
+
+    for (uint i = 0; i < hdr.n_files; ++i) {
+        const image_file& f = img.files[i];
+
+        if (f.name >= hdr.names_size || f.root > hdr.n_nodes || f.n_nodes > hdr.n_nodes - f.root)
+            throw va_error("Corrupt snapshot (bad index entry #%u): %s", i, pathname.c_str());
+    }
+}
+
+
+size_t snapshot::size() const noexcept { return _sp_image->hdr.n_files; }
+
+
+bool snapshot::contains(const fs::path& virtual_path) const {
+    return _sp_image->find(virtual_path.generic_string()) != nullptr;
+}
+
+
+parsed_file snapshot::load(const fs::path& real_path, const fs::path& virtual_path) const {
+    const image& img = *_sp_image;
+    const image_file* p_file = img.find(virtual_path.generic_string());
+    parsed_file f;
+
+    if (p_file) {
+        const fingerprint now = stamp_file(real_path);
+
+        if (now.size == p_file->size && now.mtime == p_file->mtime) {
+            tree_image_reader reader(img.nodes + p_file->root, p_file->n_nodes, img.strings, img.hdr.strings_size);
+            auto sp_tree = std::make_shared<snapshot_tree>();
+            sp_tree->up_root = reader.read();
+
+            if (!sp_tree->up_root)
+                throw va_error("Corrupt snapshot (bad tree for %s)", real_path.string().c_str());
+
+            sp_tree->sp_image = _sp_image;
+
+            static const error_queue no_errors;
+
+            f._p_root = sp_tree->up_root.get();
+            f._p_errors = &no_errors;
+            f._from_cache = true;
+            f._owner = std::move(sp_tree);
+            return f;
+        }
+    }
+
+    return parsed_file::parse(real_path);
+}
+
+
+parsed_file snapshot::get(const vfs& v, const fs::path& virtual_path) const {
+    vfs::location loc;
+
+    if (!v.locate(&loc, virtual_path))
+        throw va_error("Missing game file: %s", virtual_path.string().c_str());
+
+    if (loc.p_member)
+        return parsed_file::parse(batch_loader::read(*loc.p_archive, *loc.p_member));
+
+    /* only the base game's files are in the snapshot, under their own spelling (which, with case-insensitive lookup,
+       needn't be the one asked for) */
+    if (loc.layer == 0)
+        return load(loc.real_path, loc.real_path.lexically_relative(v.layer_path(0)));
+
+    return parsed_file::parse(loc.real_path);
+}
+
+
+_PDX_NAMESPACE_END
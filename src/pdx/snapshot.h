@@ -0,0 +1,60 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+#include "vfs.h"
+#include "parse_cache.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* SNAPSHOT -- every script file in the base game, parsed ahead of time into one image which is mapped at startup
+ * instead. the image holds the trees (see tree_image; their strings interned across all files), and an index of the
+ * files' virtual paths along with the size & mtime each had when the snapshot was built. trees are only built from
+ * the image as they're asked for, so opening a snapshot costs next to nothing however large the game.
+ *
+ * a file which no longer matches its size & mtime (e.g., the game has since been patched) is parsed from disk as if
+ * it weren't in the snapshot, so a stale snapshot is merely slower. so are files which didn't parse cleanly when it
+ * was built, which are left out so that their errors are reported at the time of use as always.
+ */
+
+class snapshot {
+    struct image;
+    std::shared_ptr<image> _sp_image;
+
+    parsed_file load(const fs::path& real_path, const fs::path& virtual_path) const;
+
+public:
+    /* bump whenever the image format or the parser's output for any given input changes */
+    static const uint32_t VERSION = 2;
+
+    typedef std::function<void(const std::string& pathname, const char* msg)> error_callback;
+
+    /* parse every .txt file beneath game_path into a new snapshot at out_path, returning the number of files in it.
+       on_error is told of each file left out. */
+    static uint build(const fs::path& game_path, const fs::path& out_path, const error_callback& on_error);
+
+    /* map an existing snapshot (throws if it isn't one, or is from another VERSION) */
+    snapshot(const fs::path& path);
+
+    size_t size() const noexcept;
+    bool contains(const fs::path& virtual_path) const;
+
+    /* the tree for whichever file the virtual path resolves to, from the snapshot if that's the base game's & it's
+       up to date (so mod files, and any base game files which they override, are always parsed) */
+    parsed_file get(const vfs&, const fs::path& virtual_path) const;
+};
+
+
+_PDX_NAMESPACE_END
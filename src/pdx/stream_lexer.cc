@@ -0,0 +1,117 @@
+
+#include "stream_lexer.h"
+#include "scanner.h"
+#include "token.h"
+#include "error.h"
+
+#include <cassert>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+stream_lexer::stream_lexer(byte_stream& in)
+    : _in(in),
+      _yybuf(nullptr),
+      _pathname(in.name()),
+      _bytes_read(0),
+      _newlines_read(0),
+      _p_tok(nullptr),
+      _slot(0),
+      _lines(this),
+      _location(_pathname.c_str(), size_t(0), &_lines) {
+
+    if (( _yybuf = yy_create_buffer(nullptr, BUF_SZ) ) == nullptr)
+        throw va_error("Could not allocate lexer buffer: %s", _pathname.c_str());
+
+    yyreader = &stream_lexer::refill;
+    yyreader_ctx = this;
+    yy_switch_to_buffer(_yybuf);
+    yyoffset = 0;
+}
+
+
+stream_lexer::~stream_lexer() {
+    yy_delete_buffer(_yybuf);
+    yyreader = nullptr;
+    yyreader_ctx = nullptr;
+}
+
+
+/* called by flex (through YY_INPUT) whenever its buffer runs dry */
+size_t stream_lexer::refill(char* buf, size_t max_size, void* ctx) {
+    auto p = static_cast<stream_lexer*>(ctx);
+    size_t n = p->_in.read(buf, max_size);
+    p->_bytes_read += n;
+    p->_newlines_read += line_index::count_newlines(buf, n);
+    return n;
+}
+
+
+uint stream_lexer::window_lines::line(size_t offset) const {
+    const stream_lexer& lex = *p_lexer;
+    assert( offset >= lex._location._offset && offset <= lex._bytes_read && "location is no longer in the window" );
+
+    /* everything from the last-lexed token onward is still in flex's buffer, so subtract the newlines in there from
+       the running count */
+    size_t n_after = lex._bytes_read - offset;
+    size_t newlines_after = (n_after) ? line_index::count_newlines(lex._p_tok + (offset - lex._location._offset), n_after)
+                                      : 0;
+    return 1 + lex._newlines_read - newlines_after;
+}
+
+
+bool stream_lexer::next(token* p_tok) {
+    uint type;
+
+    if (( type = yylex() ) == 0) {
+        /* EOF, so signal EOF */
+        _location._offset = yyoffset;
+        _p_tok = nullptr;
+        p_tok->type = token::END;
+        p_tok->text = 0;
+        p_tok->len = 0;
+        return false;
+    }
+
+    _location._offset = yyoffset - yyleng;
+    _p_tok = yytext;
+    p_tok->type = type;
+
+    /* flex NUL-terminated yytext in-place; undo that, as our token refers to the text by length */
+    yyrestorehold();
+
+    if (type == token::COMMENT) {
+        /* nobody looks at comments' text, so don't bother copying it */
+        p_tok->text = yytext;
+        p_tok->len = yyleng;
+        return true;
+    }
+
+    const char* text = yytext;
+    uint len = yyleng;
+
+    if (type == token::QSTR || type == token::QDATE) {
+        assert( len >= 2 );
+
+        /* trim quote characters from actual string */
+        ++text;
+        len -= 2;
+    }
+    else if (len > 0 && text[len-1] == '\r') {
+        /* if found, strip any trailing '\r' */
+        --len;
+    }
+
+    /* copy the text out of flex's buffer before it's recycled */
+    std::string& slot = _slots[_slot];
+    _slot = (_slot + 1) & (N_SLOTS - 1);
+    slot.assign(text, len);
+
+    p_tok->text = &slot[0];
+    p_tok->len = len;
+    return true;
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,82 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+
+#include "byte_stream.h"
+#include "file_location.h"
+#include "line_index.h"
+
+
+struct yy_buffer_state;
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+struct token;
+
+
+/* STREAM_LEXER -- tokenizes script text which arrives a piece at a time from a byte_stream (e.g., a savegame as it is
+ * inflated out of a zip archive, or a big file as it is read ahead), so that input of any size is lexed in bounded memory. flex recycles its buffer as it
+ * goes, so rather than referring to their text in-place as pdx::lexer's do, tokens are copied out into a small ring of
+ * slots: a token's text stays valid until N_SLOTS more tokens have been lexed, which covers basic_parser's lookahead.
+ *
+ * likewise there's no whole input to build a line_index from. newlines are counted as the input arrives instead, which
+ * is enough to find the line of the last-lexed token -- but not of any before it, so locations must be resolved right
+ * away (as pdx::error does).
+ */
+class stream_lexer {
+    static const int  BUF_SZ  = 1 << 18; // flex's buffer, which only grows if a single token won't fit
+    static const uint N_SLOTS = 8;       // must be a power of 2
+
+    /* counts the newlines between the last-lexed token and the end of what has been read */
+    struct window_lines final : line_resolver {
+        const stream_lexer* p_lexer;
+
+        window_lines(const stream_lexer* p) : p_lexer(p) {}
+        uint line(size_t offset) const override;
+        uint column(size_t) const override { return 0; }
+    };
+
+    byte_stream& _in;
+    yy_buffer_state* _yybuf;
+    std::string _pathname;
+
+    size_t _bytes_read;
+    size_t _newlines_read;
+    const char* _p_tok; // start of the last-lexed token within flex's buffer
+
+    std::string _slots[N_SLOTS];
+    uint _slot;
+
+    window_lines _lines;
+
+    /* position of last-lexed token */
+    file_location _location;
+
+    static size_t refill(char* buf, size_t max_size, void* ctx);
+
+public:
+    stream_lexer() = delete;
+    stream_lexer(const stream_lexer&) = delete;
+    stream_lexer(byte_stream&);
+    ~stream_lexer();
+
+    bool next(token* p_tok);
+
+    /* there's never a whole input to hand (so brace_index-based presizing doesn't apply) */
+    const char* input() const noexcept { return nullptr; }
+    size_t input_size() const noexcept { return 0; }
+
+    const char* pathname() const noexcept { return _location.pathname(); }
+    uint line() const { return _location.line(); }
+    uint column() const { return _location.column(); }
+    size_t offset() const noexcept { return _location.offset(); }
+    const file_location& location() const noexcept { return _location; }
+};
+
+
+_PDX_NAMESPACE_END
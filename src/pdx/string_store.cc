@@ -0,0 +1,36 @@
+#include "string_store.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+string_store::~string_store() {
+    consolidate();
+}
+
+
+void string_store::publish(pool_type::chunk_list&& chunks) {
+    if (chunks.empty())
+        return;
+
+    batch* p = new batch{ std::move(chunks), _p_published.load(std::memory_order_relaxed) };
+
+    while (!_p_published.compare_exchange_weak(p->p_next, p, std::memory_order_release, std::memory_order_relaxed))
+        ; // (p->p_next now holds the head we lost to, so just try again)
+}
+
+
+void string_store::consolidate() {
+    batch* p = _p_published.exchange(nullptr, std::memory_order_acquire);
+
+    while (p) {
+        _chunks.splice(std::move(p->chunks)); // (relinks the chunks, moving none)
+
+        batch* p_next = p->p_next;
+        delete p;
+        p = p_next;
+    }
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,66 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <atomic>
+#include <cstddef>
+
+#include "cstr_pool.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* string_store -- a home for the strings of parse trees which are to outlive their parsers, allocated from any number
+ * of threads at once. each thread parses through a writer of its own, whose pool it hands to every parser it runs
+ * (via parse_options::p_strings), so allocation is exactly as cheap as with a parser's own pool: no locks, no atomics.
+ * when the writer goes, it publishes its pool's chunks to the store by pushing them onto a lock-free list, and
+ * consolidate() later takes everything published into the store proper. nothing is ever copied, so every string stays
+ * where it was first put, for as long as the store lives.
+ *
+ * a writer's strings are valid as soon as they're allocated (publishing is only a transfer of ownership), but a
+ * writer must only be used from one thread at a time, and the store must outlive every writer and every tree.
+ */
+class string_store {
+public:
+    typedef cstr_pool<char> pool_type;
+
+    class writer {
+        string_store& _store;
+        pool_type _pool;
+
+    public:
+        writer(string_store& store) : _store(store) {}
+        writer(const writer&) = delete;
+        ~writer() { _store.publish(_pool.release()); }
+
+        pool_type& pool() noexcept { return _pool; }
+    };
+
+private:
+    /* a writer's chunks, as published */
+    struct batch {
+        pool_type::chunk_list chunks;
+        batch* p_next;
+    };
+
+    std::atomic<batch*> _p_published; // most recent first
+    pool_type::chunk_list _chunks;    // as consolidated
+
+public:
+    string_store() : _p_published(nullptr) {}
+    string_store(const string_store&) = delete;
+    ~string_store();
+
+    /* take over a pool's chunks. lock-free, and safe from any thread. */
+    void publish(pool_type::chunk_list&&);
+
+    /* take over everything published thus far. safe alongside publish(), but not alongside itself. */
+    void consolidate();
+
+    size_t n_chunks() const noexcept { return _chunks.size(); } // as consolidated
+};
+
+
+_PDX_NAMESPACE_END
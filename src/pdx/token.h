@@ -7,9 +7,15 @@
 _PDX_NAMESPACE_BEGIN
 
 
+/* a token's text refers in-place to the lexer's input buffer and is NOT NUL-terminated; len is authoritative.
+ *
+ * a binary source has no text for numbers, so it leaves text null and decodes an INTEGER's or DECIMAL's value itself
+ * (the latter in thousandths, i.e. as fp3's representation). */
 struct token {
     uint type;
+    int32_t value; // only when text is null
     char* text;
+    uint len;
 
     /* token type identifier constants, sequentially defined starting
        from EOF and ending with the FAIL token */
@@ -31,7 +37,7 @@ struct token {
     const char* type_name() const { return TYPE_MAP[type]; }
 
     token() {}
-    token(uint _type, char* _text) : type(_type), text(_text) {}
+    token(uint _type, char* _text, uint _len) : type(_type), text(_text), len(_len) {}
 };
 
 
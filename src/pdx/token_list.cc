@@ -0,0 +1,56 @@
+#include "token_list.h"
+#include "error.h"
+
+#include <limits>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+lexed_text lexed_text::lex(loaded_file&& f) {
+    if (f.size >= std::numeric_limits<uint32_t>::max())
+        throw va_error("File is too big to lex up front: %s", f.pathname.c_str());
+
+    lexed_text t{ std::move(f.pathname), std::move(f.data), f.size, {}, 0 };
+    t.tokens.reserve(t.size / 6); // (about a token per 6 bytes of typical script, comments & all)
+
+    lexer lex(memory_span{ t.data.get(), t.size, t.pathname.c_str() });
+    token tok;
+
+    while (lex.next(&tok))
+        t.tokens.push_back({ uint32_t(lex.offset()), tok.len, tok.type });
+
+    t.end_offset = lex.offset();
+    return t;
+}
+
+
+token_list::token_list(lexed_text&& text)
+    : _text(std::move(text)),
+      _next(0),
+      _location(_text.pathname.c_str(), size_t(0), &_lines) {
+    _lines.assign(_text.data.get(), _text.size);
+}
+
+
+bool token_list::next(token* p_tok) {
+    if (_next == _text.tokens.size()) {
+        _location._offset = _text.end_offset;
+        p_tok->type = token::END;
+        p_tok->text = 0;
+        p_tok->len = 0;
+        return false;
+    }
+
+    const lexed_text::lexed_token& t = _text.tokens[_next++];
+    const bool quoted = (t.type == token::QSTR || t.type == token::QDATE);
+
+    _location._offset = t.offset;
+    p_tok->type = t.type;
+    p_tok->text = _text.data.get() + t.offset + ((quoted) ? 1 : 0);
+    p_tok->len = t.len;
+    return true;
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,70 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "lexer.h"
+#include "token.h"
+#include "line_index.h"
+#include "file_location.h"
+#include "batch_loader.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* lexed_text -- script text along with all of its tokens, lexed up front. the lexer being what it is, lexing must
+ * happen on one thread at a time, but the result may then be parsed (via a token_list) on any thread, so that tree
+ * building can proceed in parallel with the lexing of the next file (see audit_pipeline). a token costs 12 bytes. */
+struct lexed_text {
+    struct lexed_token {
+        uint32_t offset; // of the token's first character (a quote, for QSTR & QDATE)
+        uint32_t len;    // of its text, as pdx::lexer would give it
+        uint32_t type;
+    };
+
+    std::string pathname;
+    std::unique_ptr<char[]> data; // followed by 2 NUL bytes, which aren't counted in size
+    size_t size;
+    std::vector<lexed_token> tokens;
+    size_t end_offset; // where lexing stopped
+
+    /* lex a whole file (taking over its buffer), which must be under 4GB. not thread-safe (see pdx::lexer). */
+    static lexed_text lex(loaded_file&&);
+
+    size_t memory_size() const noexcept { return size + 2 + tokens.capacity() * sizeof(lexed_token); }
+};
+
+
+/* token_list -- a TokenSource (see basic_parser) over a lexed_text, which it takes over, giving exactly the tokens &
+ * locations that pdx::lexer would have over the same text */
+class token_list {
+    lexed_text _text;
+    size_t _next;
+    line_index _lines;
+    file_location _location;
+
+public:
+    token_list() = delete;
+    token_list(const token_list&) = delete;
+    token_list(lexed_text&&);
+
+    bool next(token* p_tok);
+
+    const char* input() const noexcept { return _text.data.get(); }
+    size_t input_size() const noexcept { return _text.size; }
+
+    const char* pathname() const noexcept { return _location.pathname(); }
+    uint line() const { return _location.line(); }
+    uint column() const { return _location.column(); }
+    size_t offset() const noexcept { return _location.offset(); }
+    const file_location& location() const noexcept { return _location; }
+};
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,59 @@
+
+#include "token_table.h"
+#include "error.h"
+
+#include <fstream>
+#include <string>
+#include <cctype>
+#include <cstdlib>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+token_table::token_table(const fs::path& path) {
+    const std::string pathname = path.string();
+    std::ifstream f(pathname);
+
+    if (!f)
+        throw va_error("Could not open file: %s", pathname.c_str());
+
+    std::string line;
+    uint n_line = 0;
+
+    while (std::getline(f, line)) {
+        ++n_line;
+
+        const char* p = line.c_str();
+        while (isspace(static_cast<unsigned char>(*p))) ++p;
+
+        if (*p == '\0' || *p == '#')
+            continue;
+
+        char* p_end;
+        unsigned long id = strtoul(p, &p_end, 0);
+
+        if (p_end == p || id > UINT16_MAX || !isspace(static_cast<unsigned char>(*p_end)))
+            throw va_error("Malformed token ID at %s:L%u", pathname.c_str(), n_line);
+
+        p = p_end;
+        while (isspace(static_cast<unsigned char>(*p))) ++p;
+
+        const char* p_name = p;
+        while (*p && !isspace(static_cast<unsigned char>(*p))) ++p;
+
+        if (p == p_name)
+            throw va_error("Missing token name at %s:L%u", pathname.c_str(), n_line);
+
+        if (id >= _v.size())
+            _v.resize(id + 1, name{ nullptr, 0 });
+
+        if (_v[id].text)
+            throw va_error("Token ID 0x%04lx is named twice at %s:L%u", id, pathname.c_str(), n_line);
+
+        _v[id] = name{ _pool.strdup(p_name, p - p_name), uint(p - p_name) };
+    }
+}
+
+
+_PDX_NAMESPACE_END
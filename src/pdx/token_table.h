@@ -0,0 +1,52 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <vector>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+#include "cstr_pool.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* token_table -- the names behind the 16-bit token IDs of a binary (ironman) savegame. these aren't ours to ship, so
+ * they're loaded from a data file with one "<id> <name>" pair per line, where id is decimal or 0x-prefixed hex. blank
+ * lines and lines starting with '#' are ignored. e.g.:
+ *
+ *   # CK2 ironman tokens
+ *   0x2c4f  player
+ *   0x284b  birth_date
+ */
+class token_table {
+public:
+    struct name {
+        char* text; // NUL-terminated, for all the good it'll do a token
+        uint  len;
+    };
+
+private:
+    cstr_pool<char> _pool;
+    std::vector<name> _v; // indexed by ID; text is null for IDs without names
+
+public:
+    token_table() = default;
+    token_table(const token_table&) = delete;
+    token_table(const fs::path&);
+
+    /* null text if there's no such name */
+    name operator[](uint16_t id) const noexcept {
+        return (id < _v.size()) ? _v[id] : name{ nullptr, 0 };
+    }
+
+    size_t size() const noexcept { return _v.size(); }
+};
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,174 @@
+#include "tree_image.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* WRITING */
+
+uint32_t tree_image_writer::intern(const char* s) {
+    const size_t len = cstr_pool<char>::length(s);
+    auto it = _string_offsets.find(std::string_view(s, len));
+
+    if (it != _string_offsets.end())
+        return it->second;
+
+    /* unaligned & unpadded, unlike in a pool, since the table is mapped as it is and compactness matters more */
+    const cstr_header hdr{ uint32_t(len), cstr_pool<char>::hash(s) };
+    const size_t offset = _strings.size() + sizeof(hdr);
+
+    _strings.append(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+    _strings.append(s, len).push_back('\0');
+
+    _string_offsets.emplace(std::string_view(_interned.strdup(s, len), len), uint32_t(offset));
+    return uint32_t(offset);
+}
+
+
+/* nesting is bounded by the parser's maximum depth, so we can afford to recurse */
+void tree_image_writer::put(const object& o) {
+    if (o.is_string())
+        put(tree_node::STRING, intern(o.as_string()));
+    else if (o.is_integer())
+        put(tree_node::INTEGER, uint32_t(o.as_integer()));
+    else if (o.is_date()) {
+        const date d = o.as_date();
+        put(tree_node::DATE, (uint32_t(d.year()) << 16) | (uint32_t(d.month()) << 8) | d.day());
+    }
+    else if (o.is_decimal())
+        put(tree_node::DECIMAL, uint32_t(o.as_decimal().scaled()));
+    else if (o.is_block())
+        put(*o.as_block());
+    else {
+        const list& l = *o.as_list();
+        put(tree_node::LIST, uint32_t(l.size()));
+
+        for (const auto& e : l)
+            put(e);
+    }
+}
+
+
+void tree_image_writer::put(const block& b) {
+    put(tree_node::BLOCK, uint32_t(b.size()));
+
+    for (const auto& s : b) {
+        put(s.key());
+        put(s.value());
+    }
+}
+
+
+/* READING */
+
+/* decode the next node into *p_obj. if it's a non-empty block or list, *p_child is set up to read its contents. */
+bool tree_image_reader::take(object* p_obj, frame* p_child) {
+    *p_child = { nullptr, nullptr, 0 };
+
+    if (_i >= _n_nodes)
+        return false;
+
+    const tree_node& n = _nodes[_i++];
+    const uint64_t n_after = _n_nodes - _i;
+
+    switch (n.kind) {
+    case tree_node::STRING: {
+        /* it must have its header before it within the table, and its terminator where that says */
+        if (n.value < sizeof(cstr_header) || n.value >= _strings_size)
+            return false;
+        cstr_header hdr;
+        memcpy(&hdr, _strings + n.value - sizeof(hdr), sizeof(hdr));
+        if (hdr.len >= _strings_size - n.value || _strings[n.value + hdr.len] != '\0')
+            return false;
+        *p_obj = object{ _strings + n.value };
+        return true;
+    }
+    case tree_node::INTEGER:
+        *p_obj = object{ int(int32_t(n.value)) };
+        return true;
+    case tree_node::DATE:
+        *p_obj = object{ date(uint16_t(n.value >> 16), uint8_t(n.value >> 8), uint8_t(n.value)) };
+        return true;
+    case tree_node::DECIMAL:
+        *p_obj = object{ fp3::from_scaled(int32_t(n.value)) };
+        return true;
+    case tree_node::BLOCK: {
+        if (n.value > n_after / 2)
+            return false;
+        auto up_block = std::make_unique<block>();
+        up_block->_vec.reserve(n.value);
+        *p_child = { up_block.get(), nullptr, n.value };
+        *p_obj = object{ std::move(up_block) };
+        return true;
+    }
+    case tree_node::LIST: {
+        if (n.value > n_after)
+            return false;
+        auto up_list = std::make_unique<list>();
+        up_list->_vec.reserve(n.value);
+        *p_child = { nullptr, up_list.get(), n.value };
+        *p_obj = object{ std::move(up_list) };
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+
+/* the same walk as the parser's, driven by an explicit stack of open blocks & lists */
+std::unique_ptr<block> tree_image_reader::read(uint max_depth) {
+    if (_n_nodes == 0 || _nodes[0].kind != tree_node::BLOCK || _nodes[0].value > (_n_nodes - 1) / 2)
+        return nullptr;
+
+    auto up_root = std::make_unique<block>();
+    up_root->_vec.reserve(_nodes[0].value);
+    _i = 1;
+
+    std::vector<frame> stack;
+    stack.reserve(32);
+    stack.push_back({ up_root.get(), nullptr, _nodes[0].value });
+
+    while (!stack.empty()) {
+        frame& top = stack.back();
+
+        if (top.n_left == 0) {
+            stack.pop_back();
+            continue;
+        }
+
+        --top.n_left;
+        frame child;
+
+        if (list* p_list = top.p_list) {
+            p_list->_vec.emplace_back();
+
+            if (!take(&p_list->_vec.back(), &child))
+                return nullptr;
+        }
+        else {
+            block* p_block = top.p_block;
+            object k, v;
+
+            if (!take(&k, &child) || child.n_left > 0 || k.is_block() || k.is_list() || !take(&v, &child))
+                return nullptr;
+
+            p_block->_vec.emplace_back(k, v);
+        }
+
+        if (child.n_left > 0) {
+            if (stack.size() >= max_depth)
+                return nullptr;
+
+            stack.push_back(child);
+        }
+    }
+
+    if (_i != _n_nodes)
+        return nullptr;
+
+    return up_root;
+}
+
+
+_PDX_NAMESPACE_END
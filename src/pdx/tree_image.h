@@ -0,0 +1,94 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <string_view>
+#include <cstdint>
+
+#include "parser.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* TREE IMAGES -- parse trees flattened for storage (see parse_cache & snapshot): each object becomes a fixed-size node,
+ * with numbers and dates already converted and strings interned in a separate table, each preceded by its cstr_header
+ * (length & hash) just as in a cstr_pool, so a tree read back has them too. blocks & lists are followed by
+ * their contents: a block's statements as key, value, key, value, ...; a list's elements in order. either may nest, so
+ * a tree is in pre-order, starting with its root block. nothing refers to an absolute position, so several trees may
+ * share one node array & string table, and an image may be mapped at any address.
+ *
+ * all in host byte order, since images are only ever read back on the machine which wrote them.
+ */
+
+struct tree_node {
+    enum : uint32_t { STRING, INTEGER, DATE, DECIMAL, BLOCK, LIST };
+
+    uint32_t kind;
+    uint32_t value; // offset of a string in the string table, a number, a packed date, or a block's/list's size
+};
+
+static_assert(sizeof(tree_node) == 8, "unexpected padding in tree_node");
+
+
+/* TREE_IMAGE_WRITER -- flattens any number of trees into one node array & string table */
+
+class tree_image_writer {
+    /* every string in a tree carries its hash (see cstr_pool), so there's no need to compute another */
+    struct cached_hash {
+        size_t operator()(std::string_view s) const noexcept { return cstr_pool<char>::hash(s.data()); }
+    };
+
+    std::vector<tree_node> _nodes;
+    std::string _strings;
+    cstr_pool<char> _interned; // a copy of each string in _strings, so that the keys below outlive the trees added
+    std::unordered_map<std::string_view, uint32_t, cached_hash> _string_offsets;
+
+    uint32_t intern(const char* s);
+    void put(uint32_t kind, uint32_t value) { _nodes.push_back({ kind, value }); }
+    void put(const object&);
+    void put(const block&);
+
+public:
+    /* add a tree, returning the index of its root node */
+    uint64_t add(const block& root) { const uint64_t i = _nodes.size(); put(root); return i; }
+
+    const std::vector<tree_node>& nodes() const noexcept { return _nodes; }
+    const std::string& strings() const noexcept { return _strings; }
+};
+
+
+/* TREE_IMAGE_READER -- rebuilds a tree from its nodes (strings then point into the string table, which must outlive
+ * the tree). images are checked as they're decoded, so a malformed one can't read out of bounds. */
+
+class tree_image_reader {
+    struct frame {
+        block* p_block;
+        list* p_list;
+        uint32_t n_left; // statements or elements yet to be read into it
+    };
+
+    const tree_node* _nodes;
+    uint64_t _n_nodes;
+    uint64_t _i; // next node
+    char* _strings;
+    uint64_t _strings_size;
+
+    bool take(object*, frame* p_child);
+
+public:
+    /* the tree's nodes (no more & no fewer), and the whole string table */
+    tree_image_reader(const tree_node* nodes, uint64_t n_nodes, char* strings, uint64_t strings_size)
+        : _nodes(nodes), _n_nodes(n_nodes), _i(0), _strings(strings), _strings_size(strings_size) {}
+
+    /* the tree, or null if the image is malformed */
+    std::unique_ptr<block> read(uint max_depth = parse_options().max_depth);
+};
+
+
+_PDX_NAMESPACE_END
@@ -5,8 +5,14 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 #include <boost/filesystem.hpp>
 
+#include "fingerprint.h"
+#include "zip_archive.h"
+#include "path_index.h"
+#include "hash.h"
+
 
 _PDX_NAMESPACE_BEGIN
 
@@ -14,22 +20,120 @@ _PDX_NAMESPACE_BEGIN
 namespace fs = boost::filesystem;
 
 class vfs {
+public:
+    /* where a virtual path resolves to: a real file, or a member of a zip archive layer */
+    struct location {
+        size_t layer;
+        fs::path real_path;                  // for an archive member, as if the archive were a folder (so no such file)
+        const zip_archive* p_archive;        // null unless it's an archive member
+        const zip_archive::member* p_member; // likewise
+        bool case_mismatch;                  // matched only case-insensitively (see index_paths)
+    };
+
+private:
     std::vector<fs::path> _path_stack;
+    std::vector<std::shared_ptr<const zip_archive>> _archives; // by layer, null for a folder
+    std::shared_ptr<const path_index> _index;                  // null unless index_paths()
+    mutable fingerprint_cache _fingerprints;
 
 public:
-    vfs(const fs::path& base_path) : _path_stack({ base_path }) {}
+    vfs(const fs::path& base_path) { push_mod_path(base_path); }
     vfs() {}
 
-    void push_mod_path(const fs::path& p) { _path_stack.push_back(p); }
+    /* a layer is a folder or else a zip archive (as Steam Workshop mods come), whose central directory is read now. an
+       archive's members are read straight from it, without extraction (see batch_loader). */
+    void push_mod_path(const fs::path& p) {
+        const bool is_archive = fs::is_regular_file(p) && zip_archive::is_zip(p);
+        _archives.push_back( (is_archive) ? std::make_shared<const zip_archive>(p) : nullptr );
+        _path_stack.push_back(p);
+        _index.reset();
+    }
+
+    /* index every layer (once all have been pushed), so that paths resolve in any casing, as on Windows. returns the
+       index, whose warnings note any files which differ only in case. with a dir_cache, only directories changed since
+       they were cached are read.
 
-    bool resolve_path(fs::path* p_real_path, const fs::path& virtual_path) const {
-        /* search path vector for a filesystem hit in reverse */
-        for (auto i = _path_stack.crbegin(); i != _path_stack.crend(); ++i)
-            if (fs::exists( *p_real_path = *i / virtual_path ))
-                return true;
+       the index isn't kept up to date with the filesystem, so locate() checks what it finds: a file added since to a
+       higher folder layer, under the exact path asked for, still wins; a file removed since falls back upon whatever it
+       overrode; and a path that's not in the index at all falls back upon an exact lookup. (so the long-running modes
+       see files come & go as without an index, though files added since only resolve in their own casing.) that costs
+       a stat or so per lookup, as without an index. */
+    const path_index& index_paths(dir_cache* p_cache = nullptr) {
+        std::vector<const zip_archive*> archives;
+
+        for (const auto& sp : _archives)
+            archives.push_back(sp.get());
+
+        _index = std::make_shared<const path_index>(_path_stack, archives, p_cache);
+        return *_index;
+    }
+
+    const path_index* index() const noexcept { return _index.get(); }
+
+    bool locate(location* p_loc, const fs::path& virtual_path) const {
+        if (_index) {
+            const std::string name = virtual_path.generic_string();
+
+            if (const std::vector<path_index::entry>* p_all = _index->find_all(name)) {
+                /* layer by layer from the top, as without an index, trying whatever paths the index has in each (in
+                   order of priority) and then, in a folder layer, the path as given, for a file added since. an
+                   archive can't change while it's mounted, so what the index has for it is all there is. */
+                auto e = p_all->cbegin();
+
+                for (size_t i = _path_stack.size(); i-- > 0; ) {
+                    const zip_archive* p_archive = _archives[i].get();
+                    bool tried_exact = false;
+
+                    for (; e != p_all->cend() && e->layer == i; ++e) {
+                        fs::path real_path = _path_stack[i] / e->path;
+                        tried_exact |= (e->path == name);
+
+                        if (p_archive || fs::exists(real_path)) {
+                            *p_loc = { i, std::move(real_path), p_archive,
+                                       (p_archive) ? p_archive->find(e->path) : nullptr, e->path != name };
+                            return true;
+                        }
+                    }
+
+                    fs::path real_path = _path_stack[i] / virtual_path;
+
+                    if (!p_archive && !tried_exact && fs::exists(real_path)) {
+                        *p_loc = { i, std::move(real_path), nullptr, nullptr, false };
+                        return true;
+                    }
+                }
+
+                return false;
+            }
+        }
+
+        /* search path vector for a hit in reverse */
+        for (size_t i = _path_stack.size(); i-- > 0; ) {
+            const zip_archive* p_archive = _archives[i].get();
+            const zip_archive::member* p_member = nullptr;
+            fs::path real_path = _path_stack[i] / virtual_path;
+
+            if (p_archive) {
+                if (( p_member = p_archive->find(virtual_path.generic_string()) ) == nullptr)
+                    continue;
+            }
+            else if (!fs::exists(real_path))
+                continue;
+
+            *p_loc = { i, std::move(real_path), p_archive, p_member, false };
+            return true;
+        }
         return false;
     }
 
+    bool resolve_path(fs::path* p_real_path, const fs::path& virtual_path) const {
+        location loc;
+        if (!locate(&loc, virtual_path))
+            return false;
+        *p_real_path = std::move(loc.real_path);
+        return true;
+    }
+
     /* a more convenient accessor which auto-throws on a nonexistent path */
     fs::path operator[](const fs::path& virtual_path) const {
         fs::path p;
@@ -50,6 +154,38 @@ public:
 
     fs::path operator[](const std::string& virtual_path) const { return (*this)[fs::path(virtual_path)]; }
     fs::path operator[](const char* virtual_path) const        { return (*this)[fs::path(virtual_path)]; }
+
+    /* layers, lowest-priority (i.e., vanilla) first */
+    size_t n_layers() const noexcept { return _path_stack.size(); }
+    const fs::path& layer_path(size_t i) const { return _path_stack.at(i); }
+    const zip_archive* layer_archive(size_t i) const { return _archives.at(i).get(); } // null for a folder
+
+    /* fingerprints, for keying caches of anything derived from game files. contents are only hashed on demand, and
+       a file is never re-read while its size & mtime are unchanged (load the previous run's fingerprints to carry that
+       across runs). */
+
+    /* of whichever real file the virtual path resolves to (throws if none, or if it's an archive member) */
+    const fingerprint& file_fingerprint(const fs::path& virtual_path) const {
+        return _fingerprints.get((*this)[virtual_path]);
+    }
+
+    /* a key which changes with the content of whatever a virtual path resolved to. for an archive member, which can't
+       change while the archive is mounted, that's its CRC-32 & size per the central directory, so it's no content hash
+       comparable with a real file's. */
+    uint64_t content_hash(const location& loc) const {
+        if (loc.p_member) {
+            const uint32_t key[2] = { loc.p_member->crc32, loc.p_member->size };
+            return hash64(key, sizeof(key));
+        }
+        return _fingerprints.get(loc.real_path).hash;
+    }
+
+    /* of one layer as a whole, which changes if any file within it does */
+    uint64_t layer_fingerprint(size_t i) const {
+        return (layer_archive(i)) ? _fingerprints.get(layer_path(i)).hash : _fingerprints.tree_hash(layer_path(i));
+    }
+
+    fingerprint_cache& fingerprints() const noexcept { return _fingerprints; }
 };
 
 
@@ -0,0 +1,245 @@
+#include "watcher.h"
+#include "error.h"
+
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#ifdef __linux__
+#define PDX_HAVE_INOTIFY 1
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+static bool is_script(const fs::path& p) {
+    std::string ext = p.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".txt";
+}
+
+
+#ifdef PDX_HAVE_INOTIFY
+
+/* IN_CREATE is only of interest for directories (files will be written & closed), but the mask is per-watch */
+static const uint32_t WATCH_MASK = IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR;
+
+
+watcher::watcher(const vfs& v, const fs::path& state_path) : _vfs(v), _auditor(v, state_path), _fd(-1) {
+    if (( _fd = inotify_init1(IN_CLOEXEC) ) < 0)
+        throw va_error("Could not initialize inotify: %s", strerror(errno));
+}
+
+
+watcher::~watcher() {
+    ::close(_fd);
+}
+
+
+/* watch a layer's directory & everything beneath it, adding any script files found there to *p_found. the watch is
+   added before the directory is read, so that nothing created in the meantime is missed. */
+void watcher::watch_tree(size_t layer, const fs::path& virtual_dir, std::set<std::string>* p_found) {
+    if (const zip_archive* p_archive = _vfs.layer_archive(layer)) {
+        /* an archive's contents are fixed once it's mounted, so there's nothing to watch, only its files to find */
+        for (const auto& m : p_archive->members())
+            if (is_script(m.name))
+                p_found->insert(m.name);
+
+        return;
+    }
+
+    const fs::path real_dir = _vfs.layer_path(layer) / virtual_dir;
+    const int wd = inotify_add_watch(_fd, real_dir.string().c_str(), WATCH_MASK);
+
+    if (wd < 0) {
+        if (errno == ENOSPC)
+            throw va_error("Out of inotify watches (see fs.inotify.max_user_watches) at %s", real_dir.string().c_str());
+
+        return; // (gone again already)
+    }
+
+    _dirs[wd] = { layer, virtual_dir };
+
+    boost::system::error_code ec;
+
+    for (fs::directory_iterator it(real_dir, ec), end; !ec && it != end; it.increment(ec)) {
+        const fs::path virtual_path = virtual_dir / it->path().filename();
+
+        if (fs::is_directory(it->status()))
+            watch_tree(layer, virtual_path, p_found);
+        else if (fs::is_regular_file(it->status()) && is_script(virtual_path))
+            p_found->insert(virtual_path.generic_string());
+    }
+}
+
+
+/* block until something changes, and then until things have been quiet for DEBOUNCE_MS, collecting the virtual path of
+   every script file which may have been changed, added, or removed */
+void watcher::wait_for_changes(std::set<std::string>* p_changed) {
+    alignas(inotify_event) char buf[65536];
+    int timeout = -1;
+    bool rescan = false;
+
+    while (true) {
+        pollfd pfd = { _fd, POLLIN, 0 };
+        const int n = ::poll(&pfd, 1, timeout);
+
+        if (n == 0)
+            break;
+
+        ssize_t len = (n > 0) ? ::read(_fd, buf, sizeof(buf)) : -1;
+
+        if (len < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+
+            throw va_error("Could not read inotify events: %s", strerror(errno));
+        }
+
+        for (const char* p = buf; p < buf + len; ) {
+            const inotify_event* ev = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                rescan = true; // events were lost, so we can't know what changed
+                continue;
+            }
+
+            auto it = _dirs.find(ev->wd);
+
+            if (it == _dirs.end())
+                continue;
+
+            if (ev->mask & IN_IGNORED) {
+                _dirs.erase(it);
+                continue;
+            }
+
+            if (ev->len == 0)
+                continue;
+
+            const watched_dir dir = it->second; // (a copy, as watch_tree may rehash _dirs)
+            const fs::path virtual_path = dir.virtual_path / ev->name;
+
+            if (!(ev->mask & IN_ISDIR)) {
+                if (is_script(virtual_path))
+                    p_changed->insert(virtual_path.generic_string());
+
+                continue;
+            }
+
+            if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                watch_tree(dir.layer, virtual_path, p_changed);
+                continue;
+            }
+
+            /* a directory deleted or moved away takes everything beneath it along. (watches on a directory moved
+               elsewhere would follow it, so they're dropped now; they're added afresh if it turns up again.) */
+            const std::string prefix = virtual_path.generic_string() + "/";
+
+            auto under = [&](const std::string& s) { return s.compare(0, prefix.size(), prefix) == 0; };
+
+            for (auto f = _files.lower_bound(prefix); f != _files.end() && under(*f); ++f)
+                p_changed->insert(*f);
+
+            for (auto d = _dirs.begin(); d != _dirs.end(); ) {
+                if (d->second.layer == dir.layer && under(d->second.virtual_path.generic_string() + "/")) {
+                    inotify_rm_watch(_fd, d->first);
+                    d = _dirs.erase(d);
+                }
+                else
+                    ++d;
+            }
+        }
+
+        if (!p_changed->empty() || rescan)
+            timeout = DEBOUNCE_MS;
+    }
+
+    if (rescan) {
+        for (size_t i = 0; i < _vfs.n_layers(); ++i)
+            watch_tree(i, fs::path(), p_changed);
+
+        p_changed->insert(_files.cbegin(), _files.cend());
+    }
+}
+
+
+void watcher::run(std::ostream& os) {
+    std::set<std::string> files;
+
+    for (size_t i = 0; i < _vfs.n_layers(); ++i)
+        watch_tree(i, fs::path(), &files);
+
+    os << audit(files) << std::flush;
+
+    while (true) {
+        std::set<std::string> changed;
+        wait_for_changes(&changed);
+        os << audit(changed) << std::flush;
+    }
+}
+
+#else
+
+watcher::watcher(const vfs& v, const fs::path& state_path) : _vfs(v), _auditor(v, state_path), _fd(-1) {
+    throw va_error("Watch mode is not supported on this platform");
+}
+
+watcher::~watcher() {}
+void watcher::watch_tree(size_t, const fs::path&, std::set<std::string>*) {}
+void watcher::wait_for_changes(std::set<std::string>*) {}
+void watcher::run(std::ostream&) { throw va_error("Watch mode is not supported on this platform"); }
+
+#endif
+
+
+std::string watcher::audit(const std::set<std::string>& virtual_paths) {
+    const auto t0 = std::chrono::steady_clock::now();
+    std::string out;
+    uint n_files = 0;
+    uint n_reparsed = 0;
+    const uint64_t n_shared = _auditor.n_shared();
+
+    for (const auto& vp : virtual_paths) {
+        vfs::location loc;
+
+        if (!_vfs.locate(&loc, vp)) {
+            if (_files.erase(vp)) {
+                _auditor.forget(vp);
+                out += "gone " + vp + "\n";
+            }
+
+            continue;
+        }
+
+        if (loc.case_mismatch)
+            continue; // (shadowed by the same path in another case, which is audited by its own name)
+
+        _files.insert(vp);
+        ++n_files;
+        n_reparsed += _auditor.audit(vp, &out);
+    }
+
+    try {
+        _auditor.save();
+    }
+    catch (const std::exception& e) {
+        out += std::string("warning: ") + e.what() + "\n"; // (the findings stand, so the watch carries on)
+    }
+
+    const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0);
+
+    out += "done " + std::to_string(n_files) + " files, " + std::to_string(n_reparsed) + " reparsed, "
+         + std::to_string(_auditor.n_shared() - n_shared) + " shared, " + std::to_string(ms.count()) + " ms\n\n";
+
+    return out;
+}
+
+
+_PDX_NAMESPACE_END
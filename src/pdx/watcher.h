@@ -0,0 +1,66 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <set>
+#include <unordered_map>
+#include <ostream>
+#include <boost/filesystem.hpp>
+
+#include "vfs.h"
+#include "file_auditor.h"
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* WATCHER -- audits every script (.txt) file in the vfs, and then re-audits files as they change on disk, for as long
+ * as it's left running. every layer root and each of its subdirectories is watched (via inotify, so on Linux only).
+ * changes are debounced, so that an editor's burst of writes & renames on save is handled as one, and then only the
+ * files which were changed, added, or removed are re-audited, against trees kept resident in between (see
+ * file_auditor). so a save costs one file's parse rather than reloading the mod. a zip archive layer isn't watched,
+ * being read once when it's mounted (see vfs).
+ *
+ * each round of findings is in file_auditor's format, plus:
+ *
+ *   gone <path>                        (no longer in any layer)
+ *   done <n> files, <n> reparsed, <n> shared, <n> ms   (those reparsed, of which shared another file's tree)
+ */
+
+class watcher {
+    /* DEBOUNCE_MS of quiet after a change before it's acted upon */
+    static const int DEBOUNCE_MS = 200;
+
+    struct watched_dir {
+        size_t layer;
+        fs::path virtual_path;
+    };
+
+    const vfs& _vfs;
+    file_auditor _auditor;
+    int _fd;
+    std::unordered_map<int, watched_dir> _dirs; // by watch descriptor
+    std::set<std::string> _files;               // every script file currently in some layer, by virtual path
+
+    void watch_tree(size_t layer, const fs::path& virtual_dir, std::set<std::string>* p_found);
+    void wait_for_changes(std::set<std::string>* p_changed);
+    std::string audit(const std::set<std::string>& virtual_paths);
+
+public:
+    /* throws if the platform can't watch files. given a state path, findings are kept there between runs (see
+       file_auditor), and saved after every round. */
+    watcher(const vfs&, const fs::path& state_path = fs::path());
+    watcher(const watcher&) = delete;
+    ~watcher();
+
+    /* audit everything, and then keep re-auditing what changes, writing findings to os. never returns. */
+    [[noreturn]] void run(std::ostream& os);
+};
+
+
+_PDX_NAMESPACE_END
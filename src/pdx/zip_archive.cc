@@ -0,0 +1,197 @@
+
+#include "zip_archive.h"
+#include "error.h"
+
+#include <memory>
+#include <cstring>
+#include <zlib.h>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+/* all multi-byte zip fields are little-endian, whatever the host */
+static inline uint16_t le16(const unsigned char* p) { return uint16_t(p[0] | (p[1] << 8)); }
+static inline uint32_t le32(const unsigned char* p) { return uint32_t(le16(p)) | (uint32_t(le16(p + 2)) << 16); }
+
+static const uint32_t SIG_LOCAL_HEADER   = 0x04034b50;
+static const uint32_t SIG_CENTRAL_HEADER = 0x02014b50;
+static const uint32_t SIG_END_OF_CD      = 0x06054b50;
+
+static const size_t LOCAL_HEADER_SZ   = 30;
+static const size_t CENTRAL_HEADER_SZ = 46;
+static const size_t END_OF_CD_SZ      = 22;
+static const size_t MAX_COMMENT_SZ    = 0xFFFF; // the end-of-central-directory record may be followed by a comment
+
+
+typedef std::unique_ptr<std::FILE, int (*)(std::FILE*)> file_ptr;
+
+
+static void read_at(std::FILE* f, long offset, void* buf, size_t sz, const char* pathname) {
+    if (std::fseek(f, offset, SEEK_SET) != 0 || std::fread(buf, 1, sz, f) != sz)
+        throw va_error("Could not read zip archive: %s", pathname);
+}
+
+
+zip_archive::zip_archive(const fs::path& path) : _pathname(path.string()) {
+    const char* pathname = _pathname.c_str();
+    file_ptr f( std::fopen(pathname, "rb"), std::fclose );
+
+    if (f.get() == nullptr)
+        throw va_error("Could not open file: %s", pathname);
+
+    long size;
+
+    if (std::fseek(f.get(), 0, SEEK_END) != 0 || ( size = std::ftell(f.get()) ) < 0)
+        throw va_error("Could not determine size of file: %s", pathname);
+
+    /* find the end-of-central-directory record by scanning backward over the tail of the file, which is as long as
+       the largest possible archive comment */
+
+    size_t tail_sz = std::min(size_t(size), END_OF_CD_SZ + MAX_COMMENT_SZ);
+    std::vector<unsigned char> tail(tail_sz);
+    read_at(f.get(), size - tail_sz, tail.data(), tail_sz, pathname);
+
+    const unsigned char* p_eocd = nullptr;
+
+    if (tail_sz >= END_OF_CD_SZ) {
+        for (size_t i = tail_sz - END_OF_CD_SZ + 1; i-- > 0; ) {
+            if (le32(&tail[i]) == SIG_END_OF_CD) {
+                p_eocd = &tail[i];
+                break;
+            }
+        }
+    }
+
+    if (p_eocd == nullptr)
+        throw va_error("Not a zip archive (no end of central directory record): %s", pathname);
+
+    uint16_t n_members = le16(p_eocd + 10);
+    uint32_t cd_sz     = le32(p_eocd + 12);
+    uint32_t cd_offset = le32(p_eocd + 16);
+
+    if (n_members == 0xFFFF || cd_sz == 0xFFFFFFFF || cd_offset == 0xFFFFFFFF)
+        throw va_error("zip64 archives are not supported: %s", pathname);
+
+    if (long(cd_offset) + long(cd_sz) > size)
+        throw va_error("Corrupt zip archive (central directory out of bounds): %s", pathname);
+
+    /* read & walk the central directory */
+
+    std::vector<unsigned char> cd(cd_sz);
+    read_at(f.get(), cd_offset, cd.data(), cd_sz, pathname);
+
+    _members.reserve(n_members);
+    size_t i = 0;
+
+    for (uint16_t n = 0; n < n_members; ++n) {
+        if (i + CENTRAL_HEADER_SZ > cd_sz || le32(&cd[i]) != SIG_CENTRAL_HEADER)
+            throw va_error("Corrupt zip archive (bad central directory entry #%u): %s", n, pathname);
+
+        const unsigned char* p = &cd[i];
+        uint16_t name_len    = le16(p + 28);
+        uint16_t extra_len   = le16(p + 30);
+        uint16_t comment_len = le16(p + 32);
+
+        if (i + CENTRAL_HEADER_SZ + name_len > cd_sz)
+            throw va_error("Corrupt zip archive (bad central directory entry #%u): %s", n, pathname);
+
+        member m;
+        m.name.assign(reinterpret_cast<const char*>(p + CENTRAL_HEADER_SZ), name_len);
+        m.flags           = le16(p + 8);
+        m.method          = le16(p + 10);
+        m.crc32           = le32(p + 16);
+        m.compressed_size = le32(p + 20);
+        m.size            = le32(p + 24);
+        m.header_offset   = le32(p + 42);
+
+        if (m.compressed_size == 0xFFFFFFFF || m.size == 0xFFFFFFFF || m.header_offset == 0xFFFFFFFF)
+            throw va_error("zip64 archives are not supported: %s", pathname);
+
+        _index.emplace(m.name, _members.size()); // (the first of any duplicate names wins, as for unzip)
+        _members.emplace_back( std::move(m) );
+        i += CENTRAL_HEADER_SZ + name_len + extra_len + comment_len;
+    }
+}
+
+
+const zip_archive::member* zip_archive::find(const std::string& name) const noexcept {
+    auto it = _index.find(name);
+    return (it != _index.end()) ? &_members[it->second] : nullptr;
+}
+
+
+void zip_archive::read(const member& m, char* out) const {
+    const std::string name = _pathname + ":" + m.name;
+
+    if (m.flags & 0x1)
+        throw va_error("Encrypted zip archive members are not supported: %s", name.c_str());
+
+    if (m.method != STORED && m.method != DEFLATED)
+        throw va_error("Unsupported zip compression method %u: %s", m.method, name.c_str());
+
+    file_ptr f( std::fopen(_pathname.c_str(), "rb"), std::fclose );
+
+    if (f.get() == nullptr)
+        throw va_error("Could not open file: %s", _pathname.c_str());
+
+    const long offset = data_offset(f.get(), m);
+
+    if (m.method == STORED) {
+        if (m.compressed_size != m.size)
+            throw va_error("Corrupt zip archive member (size mismatch): %s", name.c_str());
+
+        read_at(f.get(), offset, out, m.size, _pathname.c_str());
+    }
+    else {
+        /* the compressed data is small enough to read whole, and then it's inflated in one go. a negative window size
+           selects raw deflate data, without any zlib header/trailer (zip has its own). */
+        std::vector<unsigned char> input(m.compressed_size);
+        read_at(f.get(), offset, input.data(), input.size(), _pathname.c_str());
+
+        z_stream z;
+        memset(&z, 0, sizeof(z));
+
+        if (inflateInit2(&z, -MAX_WBITS) != Z_OK)
+            throw va_error("Could not initialize zlib: %s", name.c_str());
+
+        z.next_in = input.data();
+        z.avail_in = input.size();
+        z.next_out = reinterpret_cast<Bytef*>(out);
+        z.avail_out = m.size;
+
+        const int ret = inflate(&z, Z_FINISH);
+        const std::string msg = (z.msg) ? z.msg : "inflate failed";
+        const bool complete = (z.avail_out == 0);
+        inflateEnd(&z);
+
+        if (ret != Z_STREAM_END || !complete)
+            throw va_error("Corrupt zip archive member (%s): %s", (ret == Z_STREAM_END || ret == Z_BUF_ERROR)
+                           ? "size mismatch" : msg.c_str(), name.c_str());
+    }
+
+    if (crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(out), m.size) != m.crc32)
+        throw va_error("Corrupt zip archive member (CRC mismatch): %s", name.c_str());
+}
+
+
+long zip_archive::data_offset(std::FILE* f, const member& m) const {
+    unsigned char hdr[LOCAL_HEADER_SZ];
+    read_at(f, m.header_offset, hdr, sizeof(hdr), _pathname.c_str());
+
+    if (le32(hdr) != SIG_LOCAL_HEADER)
+        throw va_error("Corrupt zip archive (bad local header for '%s'): %s", m.name.c_str(), _pathname.c_str());
+
+    /* the local header's name & extra field lengths needn't agree with the central directory's */
+    return long(m.header_offset) + LOCAL_HEADER_SZ + le16(hdr + 26) + le16(hdr + 28);
+}
+
+
+bool zip_archive::is_zip(const fs::path& path) {
+    file_ptr f( std::fopen(path.string().c_str(), "rb"), std::fclose );
+    unsigned char sig[4];
+    return f.get() && std::fread(sig, 1, sizeof(sig), f.get()) == sizeof(sig) && le32(sig) == SIG_LOCAL_HEADER;
+}
+
+
+_PDX_NAMESPACE_END
@@ -0,0 +1,67 @@
+// -*- c++ -*-
+
+#pragma once
+#include "pdx_common.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+
+_PDX_NAMESPACE_BEGIN
+
+
+namespace fs = boost::filesystem;
+
+
+/* zip_archive -- the table of contents of a .zip file (e.g., a compressed savegame, or a mod as the Steam Workshop
+ * ships it), as read from its central directory once, up front, and indexed by member name. member data is only read
+ * by read(), which inflates a whole member into memory, or by an inflate_stream, which streams it. zip64 archives and
+ * encrypted members are not supported, which is of no concern for anything the games write.
+ */
+class zip_archive {
+public:
+    static const uint16_t STORED   = 0;
+    static const uint16_t DEFLATED = 8;
+
+    struct member {
+        std::string name;
+        uint16_t flags;
+        uint16_t method;
+        uint32_t crc32;
+        uint32_t compressed_size;
+        uint32_t size;
+        uint32_t header_offset; // of the member's local file header
+    };
+
+private:
+    std::string _pathname;
+    std::vector<member> _members;
+    std::unordered_map<std::string, size_t> _index; // into _members, by name
+
+public:
+    zip_archive() = delete;
+    zip_archive(const fs::path&);
+
+    const std::string& pathname() const noexcept { return _pathname; }
+    const std::vector<member>& members() const noexcept { return _members; }
+
+    /* null if there's no such member */
+    const member* find(const std::string& name) const noexcept;
+
+    /* inflate a whole member into out, which has room for its size, & check its CRC-32. opens the archive afresh,
+       so members may be read on several threads at once. */
+    void read(const member&, char* out) const;
+
+    /* file offset of a member's data, which follows its (variable-length) local file header within f */
+    long data_offset(std::FILE* f, const member&) const;
+
+    /* whether the file at path starts with a zip local file header (vs., e.g., a plain-text savegame) */
+    static bool is_zip(const fs::path&);
+};
+
+
+_PDX_NAMESPACE_END